@@ -0,0 +1,248 @@
+/**
+ *  @file           energy.c
+ *  @copyright		GNU General Public License
+ *
+ *  @brief Energy against deadline misses of the clock scaling, simulated on
+ *  the host. The time is simulated, a task burns its work at the speed of the
+ *  level chosen by the scheduler and the idle passes sleep until the next
+ *  tick. Three periodic tasks share the load, each run has to be done before
+ *  its next release or it is counted as a miss. The same source is built with
+ *  and without uKERNEL_USE_DVFS, both print the mean power and the miss rate
+ *  for a range of loads and for a step from a light to a heavy load.
+ *
+ *  The active power at a level is a static part plus a dynamic part going
+ *  with the cube of the speed (the voltage follows the clock), it is
+ *  uKERNEL_ACTIVE_POWER_UW at full speed.
+ *
+ *  make bench-energy
+ */
+
+#include <setjmp.h>
+#include <string.h>
+#include "uKernel.h"
+
+#define BENCH_STATIC_UW                 1000ULL
+#define BENCH_SIM_MS                    20000UL
+#define BENCH_TASKS                     3
+
+/**One periodic task of the simulation.*/
+typedef struct
+{
+    uKernelTaskDescriptor task;
+    /**Used to store the period in ms*/
+    uint32_t intervalMs;
+    /**Used to store the work of a run at full speed in us*/
+    uint32_t workUs;
+    /**Used to store the release the next run belongs to*/
+    uint32_t release;
+    /**Used to store whether the task has run once*/
+    bool started;
+    uint32_t jobs;
+    uint32_t misses;
+} benchTask;
+
+static const uint16_t _benchSpeed[uKERNEL_DVFS_LEVELS] = uKERNEL_DVFS_SPEEDS;
+static uint8_t _benchLevel = uKERNEL_DVFS_LEVELS - 1;
+/**Used to store the time spent in the tasks at each level, in us*/
+static uint64_t _benchLevelUs[uKERNEL_DVFS_LEVELS];
+/**Used to store the energy in nJ (uW times ms)*/
+static uint64_t _benchEnergy;
+/**Used to store the time of the current ms already used, in us*/
+static uint32_t _benchCarryUs;
+static uint32_t _benchEnd;
+static jmp_buf _benchDone;
+static benchTask _benchTask[BENCH_TASKS];
+
+int benchCoreId(void)
+{
+    return 0;
+}
+
+void benchSetLevel(int level)
+{
+    _benchLevel = (uint8_t) level;
+}
+
+void benchPass(void)
+{
+    if ((int32_t) (uKernelGetTime() - _benchEnd) >= 0)
+    {
+        longjmp(_benchDone, 1);
+    }
+}
+
+void benchSleep(void)
+{
+    // What is left of the ms is spent asleep
+    _benchEnergy += uKERNEL_SLEEP_POWER_UW * (1000 - _benchCarryUs) / 1000;
+    _benchCarryUs = 0;
+    uKernelTick();
+}
+
+static uint64_t benchActiveUw(uint8_t level)
+{
+    uint64_t speed = _benchSpeed[level];
+
+    return BENCH_STATIC_UW + (uKERNEL_ACTIVE_POWER_UW - BENCH_STATIC_UW)
+            * speed * speed * speed / 1000000000ULL;
+}
+
+/**Burn the work, given at full speed, at the speed of the current level.*/
+static void benchWork(uint32_t workUs)
+{
+    uint32_t timeUs = (uint32_t) (((uint64_t) workUs * 1000) / _benchSpeed[_benchLevel]);
+    uint32_t slice;
+
+    while (timeUs > 0)
+    {
+        slice = 1000 - _benchCarryUs;
+        if (slice > timeUs)
+        {
+            slice = timeUs;
+        }
+        _benchEnergy += benchActiveUw(_benchLevel) * slice / 1000;
+        _benchLevelUs[_benchLevel] += slice;
+        _benchCarryUs += slice;
+        timeUs -= slice;
+        if (_benchCarryUs == 1000)
+        {
+            _benchCarryUs = 0;
+            uKernelTick();
+        }
+    }
+}
+
+static void benchRun(benchTask *pTask)
+{
+    uint32_t now = uKernelGetTime();
+
+    if (pTask->started == false)
+    {
+        pTask->started = true;
+        pTask->release = now;
+    }
+
+    // Releases that went by without a run are missed
+    while ((now - pTask->release) >= pTask->intervalMs)
+    {
+        pTask->jobs++;
+        pTask->misses++;
+        pTask->release += pTask->intervalMs;
+    }
+
+    benchWork(pTask->workUs);
+
+    pTask->jobs++;
+    if ((uKernelGetTime() - pTask->release) > pTask->intervalMs)
+    {
+        pTask->misses++;
+    }
+    pTask->release += pTask->intervalMs;
+}
+
+static void benchTask0(void)
+{
+    benchRun(&_benchTask[0]);
+}
+
+static void benchTask1(void)
+{
+    benchRun(&_benchTask[1]);
+}
+
+static void benchTask2(void)
+{
+    benchRun(&_benchTask[2]);
+}
+
+/**Give the tasks an even share of the load, in permille of the full speed.*/
+static void benchLoad(uint16_t load)
+{
+    uint8_t i;
+
+    for (i = 0; i < BENCH_TASKS; i++)
+    {
+        _benchTask[i].workUs = ((uint32_t) load * _benchTask[i].intervalMs)
+                / BENCH_TASKS;
+    }
+}
+
+static void benchStart(uint16_t load)
+{
+    static void (* const function[BENCH_TASKS])(void) = {
+        benchTask0, benchTask1, benchTask2
+    };
+    static const uint32_t interval[BENCH_TASKS] = {10, 25, 50};
+    uint8_t i;
+
+    memset(_benchTask, 0, sizeof (_benchTask));
+    memset(_benchLevelUs, 0, sizeof (_benchLevelUs));
+    _benchEnergy = 0;
+    _benchCarryUs = 0;
+
+    uKernelInit();
+    for (i = 0; i < BENCH_TASKS; i++)
+    {
+        _benchTask[i].intervalMs = interval[i];
+        uKernelAddTask(&_benchTask[i].task, function[i], interval[i],
+                       uKernel_SCHEDULED);
+    }
+    benchLoad(load);
+}
+
+static void benchRunUntil(uint32_t end)
+{
+    _benchEnd = end;
+    if (setjmp(_benchDone) == 0)
+    {
+        uKernelScheduler();
+    }
+}
+
+static void benchPrint(const char *pName, uint32_t elapsed)
+{
+    uint32_t jobs = 0;
+    uint32_t misses = 0;
+    uint8_t i;
+
+    for (i = 0; i < BENCH_TASKS; i++)
+    {
+        jobs += _benchTask[i].jobs;
+        misses += _benchTask[i].misses;
+    }
+
+    printf("  %-12s %8llu uW %7.2f%% missed  busy ms per level",
+           pName, (unsigned long long) (_benchEnergy / elapsed),
+           jobs ? 100.0 * misses / jobs : 0.0);
+    for (i = 0; i < uKERNEL_DVFS_LEVELS; i++)
+    {
+        printf(" %6llu", (unsigned long long) (_benchLevelUs[i] / 1000));
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    static const uint16_t load[] = {100, 200, 300, 400, 600, 800, 950};
+    char name[16];
+    uint8_t i;
+
+    printf("energy: clock scaling %s, %lu ms per load\n",
+           uKERNEL_USE_DVFS ? "on" : "off", BENCH_SIM_MS);
+    for (i = 0; i < sizeof (load) / sizeof (load[0]); i++)
+    {
+        benchStart(load[i]);
+        benchRunUntil(BENCH_SIM_MS);
+        snprintf(name, sizeof (name), "load %3u", load[i]);
+        benchPrint(name, BENCH_SIM_MS);
+    }
+
+    // A light load that turns heavy, the scaling needs a window to follow
+    benchStart(100);
+    benchRunUntil(BENCH_SIM_MS / 2);
+    benchLoad(700);
+    benchRunUntil(BENCH_SIM_MS);
+    benchPrint("step 100-700", BENCH_SIM_MS);
+
+    return 0;
+}
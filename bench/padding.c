@@ -0,0 +1,138 @@
+/**
+ *  @file           padding.c
+ *  @copyright		GNU General Public License
+ *
+ *  @brief Scaling of the per-core data with and without cache line padding.
+ *  Each core is a thread running its own scheduler with one task that posts
+ *  itself again every run, so every pass writes the post queue head of the
+ *  core, its run statistics and its task descriptor. The same source is built
+ *  with uKERNEL_CACHE_LINE=64 and uKERNEL_CACHE_LINE=0, it prints the runs per
+ *  second for 1, 2 and 4 cores. Without padding the cores share cache lines
+ *  and the rate per core drops as cores are added. The threads need a CPU
+ *  each for the numbers to mean anything.
+ *
+ *  make bench-padding
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "uKernel.h"
+
+#define BENCH_RUN_MS                    500
+
+/**Task of one core, padded like the per-core data of the kernel.*/
+typedef struct
+{
+    uKernelTaskDescriptor task;
+} uKERNEL_CACHE_ALIGNED benchCoreTask;
+
+static __thread int _benchCore;
+static __thread uint64_t _benchRuns;
+static volatile int _benchStop;
+static pthread_barrier_t _benchStart;
+static benchCoreTask _benchTask[uKERNEL_CORES];
+static uint64_t _benchTotal;
+
+int benchCoreId(void)
+{
+    return _benchCore;
+}
+
+void benchPass(void)
+{
+    if (_benchStop)
+    {
+        __atomic_add_fetch(&_benchTotal, _benchRuns, __ATOMIC_RELAXED);
+        pthread_exit(NULL);
+    }
+}
+
+void benchSleep(void)
+{
+}
+
+static void benchTask(void)
+{
+    _benchRuns++;
+    uKernelEnqueueTask(&_benchTask[_benchCore].task);
+}
+
+static void *benchCore(void *pArgument)
+{
+    _benchCore = (int) (long) pArgument;
+    _benchRuns = 0;
+    uKernelInit();
+    uKernelAddTask(&_benchTask[_benchCore].task, benchTask, 1000, uKernel_PAUSED);
+    uKernelPinTask(&_benchTask[_benchCore].task, true);
+    pthread_barrier_wait(&_benchStart);
+
+    uKernelEnqueueTask(&_benchTask[_benchCore].task);
+    uKernelScheduler();
+
+    return NULL;
+}
+
+static double benchCores(int cores)
+{
+    pthread_t core[uKERNEL_CORES];
+    struct timespec start;
+    struct timespec end;
+    double elapsed;
+    int i;
+
+    // The schedulers of the last round are gone, start from clean descriptors
+    memset(_benchTask, 0, sizeof (_benchTask));
+    _benchStop = 0;
+    _benchTotal = 0;
+    pthread_barrier_init(&_benchStart, NULL, cores + 1);
+    for (i = 0; i < cores; i++)
+    {
+        pthread_create(&core[i], NULL, benchCore, (void *) (long) i);
+    }
+    pthread_barrier_wait(&_benchStart);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    usleep(BENCH_RUN_MS * 1000);
+    _benchStop = 1;
+    for (i = 0; i < cores; i++)
+    {
+        pthread_join(core[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&_benchStart);
+
+    elapsed = (double) (end.tv_sec - start.tv_sec)
+            + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return (double) _benchTotal / elapsed;
+}
+
+int main(void)
+{
+    static const int cores[] = {1, 2, 4};
+    double single = 0;
+    double rate;
+    unsigned int i;
+
+    printf("padding: uKERNEL_CACHE_LINE=%d, %ld CPUs online\n",
+           uKERNEL_CACHE_LINE, sysconf(_SC_NPROCESSORS_ONLN));
+    for (i = 0; i < sizeof (cores) / sizeof (cores[0]); i++)
+    {
+        if (cores[i] > uKERNEL_CORES)
+        {
+            break;
+        }
+        rate = benchCores(cores[i]);
+        if (i == 0)
+        {
+            single = rate;
+        }
+        printf("  %d cores %12.0f runs/s  %12.0f per core  speedup %.2f\n",
+               cores[i], rate, rate / cores[i], single ? rate / single : 0.0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/**
+ *  @file           postqueue.c
+ *  @copyright		GNU General Public License
+ *
+ *  @brief Stress of the post queue on the host. Each core is a thread running
+ *  its own scheduler with paused tasks, several producer threads post those
+ *  tasks to both cores as fast as they can. It prints the posting rate, how
+ *  many posts were merged, and the time from a post to the run of the task.
+ *  After the producers stop every task must have run after its last post,
+ *  otherwise a post was lost and it fails.
+ *
+ *  make bench-postqueue
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "uKernel.h"
+
+#define BENCH_TASKS_PER_CORE            8
+#define BENCH_TASKS                     (BENCH_TASKS_PER_CORE * uKERNEL_CORES)
+#define BENCH_PRODUCERS                 4
+#define BENCH_RUN_MS                    1000
+
+static __thread int _benchCore;
+static volatile int _benchStop;
+static pthread_barrier_t _benchStart;
+
+static uKernelTaskDescriptor _benchTask[BENCH_TASKS];
+/**Used to store the number of posts made to each task*/
+static uint64_t _benchPosted[BENCH_TASKS];
+/**Used to store the number of posts each task had seen when it last ran*/
+static uint64_t _benchSeen[BENCH_TASKS];
+/**Used to store the time of the last post of each task*/
+static uint64_t _benchStamp[BENCH_TASKS];
+static uint64_t _benchRuns;
+static uint64_t _benchLatencySum;
+static uint64_t _benchLatencyMax;
+
+int benchCoreId(void)
+{
+    return _benchCore;
+}
+
+void benchPass(void)
+{
+    if (_benchStop > 1)
+    {
+        pthread_exit(NULL);
+    }
+    sched_yield();
+}
+
+void benchSleep(void)
+{
+}
+
+static uint64_t benchNowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static void benchRun(int task)
+{
+    uint64_t posted = __atomic_load_n(&_benchPosted[task], __ATOMIC_ACQUIRE);
+    uint64_t latency = benchNowNs()
+            - __atomic_load_n(&_benchStamp[task], __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&_benchLatencyMax, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&_benchSeen[task], posted, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&_benchRuns, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_benchLatencySum, latency, __ATOMIC_RELAXED);
+    while ((latency > max)
+            && !__atomic_compare_exchange_n(&_benchLatencyMax, &max, latency,
+                                            true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+    {
+    }
+}
+
+#define BENCH_TASK(n) static void benchTask##n(void) { benchRun(n); }
+BENCH_TASK(0) BENCH_TASK(1) BENCH_TASK(2) BENCH_TASK(3)
+BENCH_TASK(4) BENCH_TASK(5) BENCH_TASK(6) BENCH_TASK(7)
+BENCH_TASK(8) BENCH_TASK(9) BENCH_TASK(10) BENCH_TASK(11)
+BENCH_TASK(12) BENCH_TASK(13) BENCH_TASK(14) BENCH_TASK(15)
+
+static void (* const _benchFunction[])(void) = {
+    benchTask0, benchTask1, benchTask2, benchTask3,
+    benchTask4, benchTask5, benchTask6, benchTask7,
+    benchTask8, benchTask9, benchTask10, benchTask11,
+    benchTask12, benchTask13, benchTask14, benchTask15
+};
+
+static void *benchCore(void *pArgument)
+{
+    int i;
+
+    _benchCore = (int) (long) pArgument;
+    uKernelInit();
+    for (i = 0; i < BENCH_TASKS_PER_CORE; i++)
+    {
+        int task = _benchCore * BENCH_TASKS_PER_CORE + i;
+
+        uKernelAddTask(&_benchTask[task], _benchFunction[task], 1000,
+                       uKernel_PAUSED);
+        uKernelPinTask(&_benchTask[task], true);
+    }
+    pthread_barrier_wait(&_benchStart);
+
+    uKernelScheduler();
+
+    return NULL;
+}
+
+static void *benchProducer(void *pArgument)
+{
+    unsigned int seed = (unsigned int) (long) pArgument;
+    uint64_t *pCount = malloc(sizeof (uint64_t));
+    int task;
+
+    *pCount = 0;
+    pthread_barrier_wait(&_benchStart);
+    while (!_benchStop)
+    {
+        task = rand_r(&seed) % BENCH_TASKS;
+        __atomic_store_n(&_benchStamp[task], benchNowNs(), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&_benchPosted[task], 1, __ATOMIC_RELEASE);
+        uKernelEnqueueTask(&_benchTask[task]);
+        (*pCount)++;
+    }
+
+    return pCount;
+}
+
+static void *benchTick(void *pArgument)
+{
+    (void) pArgument;
+
+    pthread_barrier_wait(&_benchStart);
+    while (_benchStop < 2)
+    {
+        usleep(1000);
+        uKernelTick();
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t core[uKERNEL_CORES];
+    pthread_t producer[BENCH_PRODUCERS];
+    pthread_t tick;
+    uint64_t posts = 0;
+    uint64_t *pCount;
+    uint64_t start;
+    uint64_t elapsed;
+    int lost;
+    int wait;
+    int i;
+
+    if (BENCH_TASKS > (int) (sizeof (_benchFunction) / sizeof (_benchFunction[0])))
+    {
+        printf("postqueue: more tasks than task functions\n");
+        return 1;
+    }
+
+    pthread_barrier_init(&_benchStart, NULL, uKERNEL_CORES + BENCH_PRODUCERS + 2);
+    for (i = 0; i < uKERNEL_CORES; i++)
+    {
+        pthread_create(&core[i], NULL, benchCore, (void *) (long) i);
+    }
+    for (i = 0; i < BENCH_PRODUCERS; i++)
+    {
+        pthread_create(&producer[i], NULL, benchProducer, (void *) (long) (i + 1));
+    }
+    pthread_create(&tick, NULL, benchTick, NULL);
+    pthread_barrier_wait(&_benchStart);
+
+    start = benchNowNs();
+    usleep(BENCH_RUN_MS * 1000);
+    _benchStop = 1;
+    for (i = 0; i < BENCH_PRODUCERS; i++)
+    {
+        pthread_join(producer[i], (void **) &pCount);
+        posts += *pCount;
+        free(pCount);
+    }
+    elapsed = benchNowNs() - start;
+
+    // Let the cores drain what is left, then every last post must have run
+    for (wait = 0; wait < 2000; wait++)
+    {
+        lost = 0;
+        for (i = 0; i < BENCH_TASKS; i++)
+        {
+            if (__atomic_load_n(&_benchSeen[i], __ATOMIC_ACQUIRE) != _benchPosted[i])
+            {
+                lost++;
+            }
+        }
+        if (lost == 0)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+
+    _benchStop = 2;
+    for (i = 0; i < uKERNEL_CORES; i++)
+    {
+        pthread_join(core[i], NULL);
+    }
+    pthread_join(tick, NULL);
+
+    printf("postqueue: %d cores, %d producers, %d tasks\n",
+           uKERNEL_CORES, BENCH_PRODUCERS, BENCH_TASKS);
+    printf("  posts      %12llu  %10.0f /s\n", (unsigned long long) posts,
+           posts * 1e9 / elapsed);
+    printf("  runs       %12llu  %10.0f /s  (%.1f%% of the posts merged)\n",
+           (unsigned long long) _benchRuns, _benchRuns * 1e9 / elapsed,
+           posts ? 100.0 * (double) (posts - _benchRuns) / posts : 0.0);
+    printf("  latency    %12.1f us mean, %.1f us max\n",
+           _benchRuns ? _benchLatencySum / 1e3 / _benchRuns : 0.0,
+           _benchLatencyMax / 1e3);
+    printf("  lost posts %12d  %s\n", lost, lost ? "FAIL" : "ok");
+
+    return lost ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/**
+ *  @file           xc.h
+ *  @copyright		GNU General Public License
+ *
+ *  @brief Stand-in for the compiler header, to build the scheduler on the
+ *  host for the benchmarks. There are no interrupts to mask, and the watchdog
+ *  clear of the scheduler loop calls the benchmark once per pass.
+ */
+
+#ifndef BENCH_XC_H
+#define	BENCH_XC_H
+
+/**Called by the scheduler at the end of every pass.*/
+void benchPass(void);
+/**Core running the caller, for uKERNEL_CORE_ID().*/
+int benchCoreId(void);
+/**Idle hook for uKERNEL_IDLE(), sleeps until the next tick.*/
+void benchSleep(void);
+/**Frequency hook for uKERNEL_SET_FREQUENCY().*/
+void benchSetLevel(int level);
+
+#define ClrWdt()                        benchPass()
+#define di()                            do {} while (0)
+#define ei()                            do {} while (0)
+
+#endif	/* BENCH_XC_H */
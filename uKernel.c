@@ -16,22 +16,393 @@
 
 #include "uKernel.h"
 
+/**The dispatch start time is needed to measure the run of a task.*/
+#define uKERNEL_MEASURE_RUN          (uKERNEL_USE_BUDGET || uKERNEL_USE_GROUPS \
+                                      || uKERNEL_USE_TRACE || uKERNEL_USE_WATCH \
+                                      || uKERNEL_USE_MULTICORE || uKERNEL_USE_ENERGY \
+                                      || uKERNEL_USE_DVFS)
+
+#if uKERNEL_USE_EVENTS
+#define uKERNEL_TASK_RELEASED(pTask) ((pTask)->taskReleased)
+#else
+#define uKERNEL_TASK_RELEASED(pTask) false
+#endif
+
+#if uKERNEL_USE_GROUPS
+#define uKERNEL_GROUP_ALLOWS(pTask)  (((pTask)->pGroup == NULL) \
+                                      || uKernelGroupHasBudget((pTask)->pGroup))
+#else
+#define uKERNEL_GROUP_ALLOWS(pTask)  true
+#endif
+
+/**The port's idle hook puts the core to sleep when there is nothing to do.*/
+#if defined(uKERNEL_IDLE)
+#define uKERNEL_USE_SLEEP            1
+#else
+#define uKERNEL_USE_SLEEP            0
+#endif
+
+/**Background tasks, jobs and sleep all come when a pass had nothing to do.*/
+#define uKERNEL_USE_IDLE             (uKERNEL_USE_BACKGROUND || uKERNEL_USE_JOBS \
+                                      || uKERNEL_USE_SLEEP)
+
+/**Work done each time the scheduler is back on the first task.*/
+#define uKERNEL_USE_PASS_END         (uKERNEL_USE_IDLE || uKERNEL_USE_LOOKAHEAD \
+                                      || uKERNEL_USE_MULTICORE || uKERNEL_USE_DVFS)
+
+/**Each core posts to the queue of the core owning the task.*/
+#if uKERNEL_USE_MULTICORE
+#define uKERNEL_POST_HEAD(core)      _core[core].pPostHead
+#else
+#define uKERNEL_POST_HEAD(core)      pPostHead
+#endif
+
+/**The tick looks at the budget of the task running on every core.*/
+#if uKERNEL_USE_MULTICORE
+#define uKERNEL_BUDGET(core)         _core[core].runningBudget
+#else
+#define uKERNEL_BUDGET(core)         _runningBudget
+#endif
+
+#if uKERNEL_USE_OVERHEAD
+#define uKERNEL_BODY_START()         _bodyStart = uKERNEL_CYCLE_COUNTER()
+#define uKERNEL_BODY_END()           _passBodyCycles += (uKernelCycles) \
+                                        (uKERNEL_CYCLE_COUNTER() - _bodyStart); \
+                                     _passBusy = true
+#else
+#define uKERNEL_BODY_START()
+#define uKERNEL_BODY_END()
+#endif
+
+#define uKERNEL_LATEST_NEW           0x80
+#define uKERNEL_LATEST_INDEX         0x03
+
+#define uKERNEL_POSTMORTEM_MAGIC     0xDEAD
+
+#define uKERNEL_NO_TASK_ID           0xFF
+
+#define uKERNEL_READY_SLOTS          32
+#define uKERNEL_READY_NONE           0xFF
+
+#define uKERNEL_POST_IDLE            0
+#define uKERNEL_POST_QUEUED          1
+#define uKERNEL_POST_CANCELLED       2
+
+#define uKERNEL_ENERGY_FOLD_MS       0x40000000UL
+
+#define uKERNEL_EXECUTION_SHIFT      7
+#define uKERNEL_EXECUTION_MAX_MS     0x01FF
+//average execution time in us, that is per-mille of a 1 ms interval
+#define uKERNEL_EXECUTION_US(pTask)  (((uint32_t) (pTask)->executionAverage \
+                                        * 1000) >> uKERNEL_EXECUTION_SHIFT)
+
+#define uKERNEL_BUDGET_DEMOTE        0x80
+#define uKERNEL_BUDGET_STRIKES       0x7F
+
 uint8_t _initialized;
 uint32_t _counterMs;
-uint8_t _numberTasks;
-uKernelTaskDescriptor *pTaskSchedule;
-static uKernelTaskDescriptor *pTaskFirst = NULL;
+uKERNEL_CORE_LOCAL uint8_t _numberTasks;
+uKERNEL_CORE_LOCAL uKernelTaskDescriptor *pTaskSchedule;
+static uKERNEL_CORE_LOCAL uKernelTaskDescriptor *pTaskFirst = NULL;
+static uKERNEL_CORE_LOCAL uKernelTaskDescriptor *pTaskRunning = NULL;
+#if uKERNEL_MEASURE_RUN || uKERNEL_USE_TIMESTAMPS
+static uKERNEL_CORE_LOCAL uint32_t _taskStartMs;
+#endif
+#if uKERNEL_USE_TIMESTAMPS
+static uKERNEL_CORE_LOCAL uint32_t _taskReleaseMs;
+#endif
+#if uKERNEL_USE_BUDGET
+
+/**Budget of the task running on a core, looked at by the tick.*/
+struct uKernelRunningBudget
+{
+    volatile uint32_t startMs;
+    volatile uint16_t budget;
+    volatile uint8_t armed;
+    volatile uint8_t exceeded;
+};
+#if !uKERNEL_USE_MULTICORE
+static struct uKernelRunningBudget _runningBudget;
+#endif
+#endif
+#if uKERNEL_USE_BACKGROUND
+static uKERNEL_CORE_LOCAL uKernelBackgroundTask *pBackgroundHeap[uKERNEL_MAX_BACKGROUND_TASKS];
+static uKERNEL_CORE_LOCAL uint8_t _numberBackgroundTasks;
+#endif
+#if uKERNEL_USE_IDLE
+static uKERNEL_CORE_LOCAL bool _passIdle;
+#endif
+#if uKERNEL_USE_JOBS
+static uKERNEL_CORE_LOCAL uKernelJob *pJobFirst;
+#endif
+#if uKERNEL_USE_LOOKAHEAD
+static uKERNEL_CORE_LOCAL uKernelRelease _lookahead[uKERNEL_LOOKAHEAD_DEPTH];
+static uKERNEL_CORE_LOCAL uKernelRelease _lookaheadWork[uKERNEL_LOOKAHEAD_DEPTH];
+static uKERNEL_CORE_LOCAL uint8_t _lookaheadCount;
+static uKERNEL_CORE_LOCAL uint8_t _lookaheadWorkCount;
+#endif
+#if uKERNEL_USE_CALIBRATION
+static uKERNEL_CORE_LOCAL uKernelOverhead _overhead;
+static uKERNEL_CORE_LOCAL bool _calibrating;
+#endif
+#if uKERNEL_USE_OVERHEAD
+static uKERNEL_CORE_LOCAL uKernelCycles _bodyStart;
+static uKERNEL_CORE_LOCAL uint32_t _passBodyCycles;
+static uKERNEL_CORE_LOCAL bool _passBusy;
+static uKERNEL_CORE_LOCAL uint32_t _kernelCycles;
+static uKERNEL_CORE_LOCAL uint32_t _taskCycles;
+static uKERNEL_CORE_LOCAL uint32_t _idleCycles;
+static uKERNEL_CORE_LOCAL uint32_t _windowStart;
+static uKERNEL_CORE_LOCAL uKernelCpuLoad _cpuLoad;
+static uKERNEL_CORE_LOCAL bool _cpuLoadValid;
+#endif
+#if uKERNEL_USE_READY_BITMAP
+static uKERNEL_CORE_LOCAL volatile uint32_t _readyBitmap;
+static uKERNEL_CORE_LOCAL uKernelTaskDescriptor *pReadyTask[uKERNEL_READY_SLOTS];
+#endif
+#if uKERNEL_USE_POST_QUEUE && !uKERNEL_USE_MULTICORE
+static uKernelTaskDescriptor * volatile pPostHead;
+#endif
+#if uKERNEL_USE_MULTICORE
+
+/**What the other cores write to a core, each on its own cache line.*/
+static struct
+{
+    uKernelTaskDescriptor * volatile pMigrateInbox;
+#if uKERNEL_USE_POST_QUEUE
+    uKernelTaskDescriptor * volatile pPostHead;
+#endif
+#if uKERNEL_USE_BUDGET
+    struct uKernelRunningBudget runningBudget;
+#endif
+    volatile uint16_t load;
+} uKERNEL_CACHE_ALIGNED _core[uKERNEL_CORES];
+#if uKERNEL_USE_CORE_STATS
+
+/**Statistics written by their core only, merged when read.*/
+static struct
+{
+    uKernelTaskStats task[uKERNEL_STATS_TASKS];
+} uKERNEL_CACHE_ALIGNED _coreStats[uKERNEL_CORES];
+#endif
+static uKERNEL_CORE_LOCAL uint8_t _coreId;
+static uKERNEL_CORE_LOCAL uint32_t _balanceStart;
+static uKERNEL_CORE_LOCAL uint32_t _balanceBusyMs;
+#endif
+#if uKERNEL_USE_ENERGY
+static uKERNEL_CORE_LOCAL uint32_t _energyMark;
+static uKERNEL_CORE_LOCAL uint64_t _energyElapsedMs;
+static uKERNEL_CORE_LOCAL uint64_t _energyTaskMs;
+static uKERNEL_CORE_LOCAL uint64_t _energySleepMs;
+#endif
+#if uKERNEL_USE_DVFS
+static const uint16_t _dvfsSpeed[uKERNEL_DVFS_LEVELS] = uKERNEL_DVFS_SPEEDS;
+static uKERNEL_CORE_LOCAL uint8_t _dvfsLevel;
+static uKERNEL_CORE_LOCAL uint16_t _dvfsRequired;
+static uKERNEL_CORE_LOCAL uint32_t _dvfsWindowStart;
+static uKERNEL_CORE_LOCAL uint32_t _dvfsBusyMs;
+#endif
+#if uKERNEL_USE_TASK_ID
+/**A bit per identifier in use, uKERNEL_NO_TASK_ID is never given.*/
+static uint8_t _taskIdUsed[32];
+#endif
+#if uKERNEL_USE_WATCH
+static uint32_t _watchBusyMs;
+static uint32_t _watchWindowStart;
+
+uKERNEL_WATCH_SECTION volatile uKernelWatchBlock uKernelWatch;
+#endif
+#if uKERNEL_USE_TRACE
+
+static uKERNEL_NOINIT struct
+{
+    uint16_t magic;
+    uint8_t next;
+    uint8_t count;
+    uKernelDispatchRecord record[uKERNEL_POSTMORTEM_RECORDS];
+} _postMortem;
+#endif
 
 uint8_t uKernelSetTask(uKernelTaskDescriptor *pTaskDescriptor,
                        uint32_t taskInterval,
                        uKernelTaskStatus tStatus);
+static void uKernelSchedulePass(void);
+static void uKernelDispatch(uKernelTaskDescriptor *pTask);
+static void uKernelLinkTask(uKernelTaskDescriptor *pTaskDescriptor);
+#if uKERNEL_USE_TASK_ID
+static uint8_t uKernelTaskIdAlloc(void);
+static void uKernelTaskIdFree(uint8_t taskId);
+#endif
+#if uKERNEL_USE_PHASE
+static void uKernelPlanOnGrid(uKernelTaskDescriptor *pTask);
+#endif
+#if uKERNEL_USE_LATEST
+static uint8_t uKernelLatestExchange(uKernelLatest *pLatest,
+                                     uint8_t index,
+                                     bool fromISR);
+#endif
+#if uKERNEL_USE_BUDGET
+static void uKernelCheckBudget(uKernelTaskDescriptor *pTaskDescriptor,
+                               uint32_t duration);
+#endif
+#if uKERNEL_USE_BACKGROUND
+static void uKernelRunBackgroundTask(void);
+static void uKernelHeapSiftUp(uint8_t index);
+static void uKernelHeapSiftDown(uint8_t index);
+#endif
+#if uKERNEL_USE_JOBS
+static void uKernelRunJob(void);
+static uint32_t uKernelGetSlack(void);
+#endif
+#if uKERNEL_USE_LOOKAHEAD
+static void uKernelLookaheadInsert(uKernelTaskDescriptor *pTaskDescriptor);
+static void uKernelLookaheadPublish(void);
+static uint32_t uKernelLookaheadPeriod(uKernelTaskDescriptor *pTaskDescriptor);
+static bool uKernelLookaheadSure(uint32_t releaseTime);
+#endif
+#if uKERNEL_USE_CALIBRATION
+static void uKernelCalibrate(void);
+static void uKernelCalibrationBody(void);
+#endif
+#if uKERNEL_USE_OVERHEAD
+static void uKernelAccountPass(uKernelCycles passCycles);
+#endif
+#if uKERNEL_USE_WATCH
+static void uKernelWatchInit(void);
+static void uKernelWatchUpdate(uint8_t taskId,
+                               uint32_t lateness,
+                               uint32_t duration);
+#endif
+#if uKERNEL_USE_READY_BITMAP
+static void uKernelRunReady(void);
+static void uKernelReadyReset(void);
+static uint8_t uKernelReadyAlloc(uKernelTaskDescriptor *pTaskDescriptor);
+static void uKernelReadyFree(uKernelTaskDescriptor *pTaskDescriptor);
+static void uKernelReadyPost(uint32_t mask, bool fromISR);
+#endif
+#if uKERNEL_USE_POST_QUEUE
+static void uKernelPushPost(uKernelTaskDescriptor *pTaskDescriptor,
+                            bool fromISR);
+static void uKernelRunPosted(void);
+static void uKernelCancelPost(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_MULTICORE
+static void uKernelUnlinkTask(uKernelTaskDescriptor *pTaskDescriptor);
+static void uKernelRunMigrated(void);
+static void uKernelBalance(void);
+#endif
+#if uKERNEL_USE_DEADLINE_QUEUE
+static void uKernelDeadlineSiftUp(uKernelDeadlineQueue *pQueue, uint8_t index);
+static void uKernelDeadlineSiftDown(uKernelDeadlineQueue *pQueue, uint8_t index);
+static void uKernelDeadlineRetarget(uKernelDeadlineQueue *pQueue, bool always);
+static bool uKernelDeadlineInsert(uKernelDeadlineQueue *pQueue,
+                                  void *pMessage,
+                                  uint32_t deadline);
+#endif
+#if uKERNEL_USE_ENERGY
+static uint64_t uKernelEnergyElapsed(void);
+static uint64_t uKernelEnergyUj(uint64_t activeMs, uint64_t sleepMs);
+static uint64_t uKernelPerHour(uint64_t energy, uint64_t elapsed);
+#endif
+#if uKERNEL_USE_DVFS
+static void uKernelScaleFrequency(void);
+#endif
+#if uKERNEL_USE_GROUPS
+static bool uKernelGroupHasBudget(uKernelGroup *pGroup);
+static void uKernelGroupCharge(uKernelGroup *pGroup, uint32_t duration);
+#endif
 
 void uKernelInit(void)
 {
+#if uKERNEL_USE_TASK_ID
+    uint8_t i;
+
+#endif
     _initialized = true;
     _counterMs = 0;
     _numberTasks = 0;
     pTaskSchedule = NULL;
+    pTaskFirst = NULL;
+    pTaskRunning = NULL;
+#if uKERNEL_USE_IDLE
+    _passIdle = true;
+#endif
+#if uKERNEL_USE_BACKGROUND
+    _numberBackgroundTasks = 0;
+#endif
+#if uKERNEL_USE_JOBS
+    pJobFirst = NULL;
+#endif
+#if uKERNEL_USE_LOOKAHEAD
+    _lookaheadCount = 0;
+    _lookaheadWorkCount = 0;
+#endif
+#if uKERNEL_USE_READY_BITMAP
+    uKernelReadyReset();
+#endif
+#if uKERNEL_USE_MULTICORE
+    _coreId = uKERNEL_CORE_ID();
+    _core[_coreId].pMigrateInbox = NULL;
+    _core[_coreId].load = 0;
+#if uKERNEL_USE_CORE_STATS
+    for (i = 0; i < uKERNEL_STATS_TASKS; i++)
+    {
+        _coreStats[_coreId].task[i].runCount = 0;
+        _coreStats[_coreId].task[i].busyMs = 0;
+        _coreStats[_coreId].task[i].maxExecution = 0;
+    }
+#endif
+    _balanceStart = 0;
+    _balanceBusyMs = 0;
+#endif
+#if uKERNEL_USE_POST_QUEUE
+    uKERNEL_POST_HEAD(_coreId) = NULL;
+#endif
+#if uKERNEL_USE_ENERGY
+    _energyMark = _counterMs;
+    _energyElapsedMs = 0;
+    _energyTaskMs = 0;
+    _energySleepMs = 0;
+#endif
+#if uKERNEL_USE_DVFS
+    // Start at full speed until the load has been measured
+    _dvfsLevel = uKERNEL_DVFS_LEVELS - 1;
+    _dvfsRequired = 0;
+    _dvfsWindowStart = 0;
+    _dvfsBusyMs = 0;
+    uKERNEL_SET_FREQUENCY(_dvfsLevel);
+#endif
+#if uKERNEL_USE_TASK_ID && !uKERNEL_USE_MULTICORE
+    // With several cores the others may already hold identifiers
+    for (i = 0; i < sizeof (_taskIdUsed); i++)
+    {
+        _taskIdUsed[i] = 0;
+    }
+#endif
+#if uKERNEL_USE_TRACE
+    // Keep the ring of the previous run if it is consistent
+    if ((_postMortem.magic != uKERNEL_POSTMORTEM_MAGIC)
+            || (_postMortem.next >= uKERNEL_POSTMORTEM_RECORDS)
+            || (_postMortem.count > uKERNEL_POSTMORTEM_RECORDS))
+    {
+        _postMortem.magic = uKERNEL_POSTMORTEM_MAGIC;
+        _postMortem.next = 0;
+        _postMortem.count = 0;
+    }
+#endif
+#if uKERNEL_USE_OVERHEAD
+    _kernelCycles = 0;
+    _taskCycles = 0;
+    _idleCycles = 0;
+    _windowStart = 0;
+    _cpuLoadValid = false;
+#endif
+#if uKERNEL_USE_CALIBRATION
+    uKernelCalibrate();
+#endif
+#if uKERNEL_USE_WATCH
+    uKernelWatchInit();
+#endif
 }
 
 bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
@@ -39,8 +410,6 @@ bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
                     uint32_t taskInterval,
                     uKernelTaskStatus taskStatus)
 {
-    uKernelTaskDescriptor *pTaskWork = NULL;
-
     if ((_initialized == false) || (_numberTasks == MAX_TASKS_NUMBER)
             || (userTask == NULL))
     {
@@ -60,28 +429,8 @@ bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
 
     if (pTaskDescriptor != NULL)
     {
-        if (pTaskFirst != NULL)
-        {
-            // Initialize the work pointer with the scheduler pointer (never mind is current state)
-            pTaskWork = pTaskSchedule;
-            // Research the last task from the circular linked list : so research the adresse of the
-            // first task in testing the pTaskNext fields of each structure
-            while (pTaskWork->pTaskNext != pTaskFirst)
-            {
-                // Set the work pointer on the next task
-                pTaskWork = pTaskWork->pTaskNext;
-            }
-            pTaskWork->pTaskNext = pTaskDescriptor; // Insert the new task at the end of the circular linked list
+        uKernelLinkTask(pTaskDescriptor);
 
-            pTaskDescriptor->pTaskNext = pTaskFirst; // The next task is feedback at the first task
-        }
-        else
-        {
-            // There is no task in the scheduler, this task become the First task in the circular linked list
-            pTaskFirst = pTaskDescriptor; // The pTaskFirst pointer is initialize with the first task of the scheduler
-            pTaskSchedule = pTaskFirst; // Initialize the scheduler pointer at the first task
-            pTaskDescriptor->pTaskNext = pTaskDescriptor; // The next task is itself because there is just one task in the circular linked list
-        }
         // Common initialization for all tasks
         // no wait if the user wants the task up and running once added...
         //...otherwise we wait for the interval before to run the task
@@ -92,6 +441,45 @@ bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
         pTaskDescriptor->userTasksInterval = taskInterval;
         // Set the task pointer on the task body
         pTaskDescriptor->taskPointer = userTask;
+#if uKERNEL_USE_EVENTS
+        pTaskDescriptor->taskReleased = false;
+#endif
+#if uKERNEL_USE_BUDGET
+        pTaskDescriptor->executionBudget = 0;
+        pTaskDescriptor->budgetViolations = 0;
+        pTaskDescriptor->budgetStrikes = 0;
+#endif
+#if uKERNEL_USE_GROUPS
+        pTaskDescriptor->pGroup = NULL;
+#endif
+#if uKERNEL_USE_TASK_ID
+        pTaskDescriptor->taskId = uKernelTaskIdAlloc();
+#endif
+#if uKERNEL_USE_READY_BITMAP
+        pTaskDescriptor->readySlot = uKernelReadyAlloc(pTaskDescriptor);
+#endif
+#if uKERNEL_USE_POST_QUEUE
+        // A task removed with a post pending is still linked in the queue,
+        // the drain unlinks it
+        if (pTaskDescriptor->postState != uKERNEL_POST_CANCELLED)
+        {
+            pTaskDescriptor->pPostNext = NULL;
+            pTaskDescriptor->postState = uKERNEL_POST_IDLE;
+        }
+#endif
+#if uKERNEL_USE_ENERGY
+        pTaskDescriptor->activeMs = 0;
+#endif
+#if uKERNEL_USE_MULTICORE
+        pTaskDescriptor->taskCore = _coreId;
+        pTaskDescriptor->taskPinned = false;
+#endif
+#if uKERNEL_USE_EXEC_AVERAGE
+        pTaskDescriptor->executionAverage = 0;
+#endif
+#if uKERNEL_USE_PHASE
+        pTaskDescriptor->phaseAnchor = pTaskDescriptor->plannedTask;
+#endif
         //I get only the first 2 bits - I don't need the IMMEDIATESTART bit
         pTaskDescriptor->taskStatus = taskStatus & 0x03;
 
@@ -105,11 +493,93 @@ bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
         // This case is necessary at the time of the call of the function DeleteAllTask()
         pTaskFirst = NULL;
         pTaskSchedule = NULL;
+#if uKERNEL_USE_READY_BITMAP
+        uKernelReadyReset();
+#endif
+#if uKERNEL_USE_POST_QUEUE
+        uKERNEL_POST_HEAD(_coreId) = NULL;
+#endif
 
         return true;
     }
 }
 
+/**Put a task at the end of the circular linked list.*/
+static void uKernelLinkTask(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    uKernelTaskDescriptor *pTaskWork = NULL;
+
+    if (pTaskFirst != NULL)
+    {
+        // Initialize the work pointer with the scheduler pointer (never mind is current state)
+        pTaskWork = pTaskSchedule;
+        // Research the last task from the circular linked list : so research the adresse of the
+        // first task in testing the pTaskNext fields of each structure
+        while (pTaskWork->pTaskNext != pTaskFirst)
+        {
+            // Set the work pointer on the next task
+            pTaskWork = pTaskWork->pTaskNext;
+        }
+        pTaskWork->pTaskNext = pTaskDescriptor; // Insert the new task at the end of the circular linked list
+
+        pTaskDescriptor->pTaskNext = pTaskFirst; // The next task is feedback at the first task
+    }
+    else
+    {
+        // There is no task in the scheduler, this task become the First task in the circular linked list
+        pTaskFirst = pTaskDescriptor; // The pTaskFirst pointer is initialize with the first task of the scheduler
+        pTaskSchedule = pTaskFirst; // Initialize the scheduler pointer at the first task
+        pTaskDescriptor->pTaskNext = pTaskDescriptor; // The next task is itself because there is just one task in the circular linked list
+    }
+}
+
+#if uKERNEL_USE_RELEASE_AT
+
+bool uKernelAddTaskAt(uKernelTaskDescriptor *pTaskDescriptor,
+                      void (*userTask)(void),
+                      uint32_t taskInterval,
+                      uKernelTaskStatus taskStatus,
+                      uint32_t releaseTime)
+{
+    if ((pTaskDescriptor == NULL) || (taskStatus == uKernel_PAUSED)
+            || (taskStatus > uKernel_ONETIME_IMMEDIATESTART))
+    {
+        return false;
+    }
+
+    //add it paused so it can't run before its release time is set
+    if (uKernelAddTask(pTaskDescriptor, userTask, taskInterval,
+                       uKernel_PAUSED) == false)
+    {
+        return false;
+    }
+
+    return uKernelRescheduleAt(pTaskDescriptor, releaseTime, taskStatus);
+}
+
+bool uKernelRescheduleAt(uKernelTaskDescriptor *pTaskDescriptor,
+                         uint32_t releaseTime,
+                         uKernelTaskStatus taskStatus)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL)
+            || (taskStatus == uKernel_PAUSED)
+            || (taskStatus > uKernel_ONETIME_IMMEDIATESTART))
+    {
+        return false;
+    }
+
+    pTaskDescriptor->plannedTask = releaseTime;
+#if uKERNEL_USE_PHASE
+    pTaskDescriptor->phaseAnchor = releaseTime;
+#endif
+    //the IMMEDIATESTART bit makes no sense here
+    pTaskDescriptor->taskStatus = taskStatus & 0x03;
+
+    return true;
+}
+
+#endif
+
 bool uKernelRemoveTask(uKernelTaskDescriptor *pTaskDescriptor)
 {
     uKernelTaskDescriptor *pTaskCurr = NULL;
@@ -137,6 +607,16 @@ bool uKernelRemoveTask(uKernelTaskDescriptor *pTaskDescriptor)
     {
         pTaskCurr->pTaskNext = pTaskDescriptor->pTaskNext;
     }
+#if uKERNEL_USE_READY_BITMAP
+    uKernelReadyFree(pTaskDescriptor);
+#endif
+#if uKERNEL_USE_POST_QUEUE
+    uKernelCancelPost(pTaskDescriptor);
+#endif
+#if uKERNEL_USE_TASK_ID
+    uKernelTaskIdFree(pTaskDescriptor->taskId);
+    pTaskDescriptor->taskId = uKERNEL_NO_TASK_ID;
+#endif
 
     _numberTasks--;
 
@@ -153,6 +633,96 @@ bool uKernelResumeTask(uKernelTaskDescriptor *pTaskDescriptor, uKernelTaskStatus
     return (uKernelSetTask(pTaskDescriptor, NULL, taskStatus));
 }
 
+#if uKERNEL_USE_PHASE
+
+bool uKernelResumeTaskInPhase(uKernelTaskDescriptor *pTaskDescriptor,
+                              uKernelTaskStatus taskStatus)
+{
+    uint32_t elapsed;
+    uint32_t periods;
+    uint32_t interval;
+
+    if ((_initialized == false) || (pTaskDescriptor == NULL)
+            || (taskStatus == uKernel_PAUSED)
+            || (taskStatus > uKernel_ONETIME_IMMEDIATESTART))
+    {
+        return false;
+    }
+
+    interval = pTaskDescriptor->userTasksInterval;
+    if (interval == 0)
+    {
+        //no grid, uKernelModifyTask accepts a zero interval
+        return false;
+    }
+
+    elapsed = _counterMs - pTaskDescriptor->phaseAnchor;
+
+    if (pTaskDescriptor->phaseAnchor == pTaskDescriptor->plannedTask)
+    {
+        // Not released yet, the anchor is the first release set by the API
+        if ((int32_t) elapsed <= 0)
+        {
+            //the first release is still to come
+            elapsed = 0;
+        }
+    }
+
+    // Round up to the next release on the grid
+    periods = elapsed / interval;
+    if ((elapsed % interval) != 0)
+    {
+        periods++;
+    }
+
+    if ((periods == 0)
+            && (pTaskDescriptor->phaseAnchor != pTaskDescriptor->plannedTask))
+    {
+        //the anchor is a release already done, so the time since then is
+        //never a release to come, the next one is a period after it
+        periods = 1;
+    }
+
+    pTaskDescriptor->plannedTask =
+            pTaskDescriptor->phaseAnchor + periods * interval;
+
+    //the IMMEDIATESTART bit makes no sense here
+    pTaskDescriptor->taskStatus = taskStatus & 0x03;
+
+    return true;
+}
+
+/**
+ * Plan the next release of a periodic task on its grid: a late run doesn't
+ * shift the releases after it and the releases missed are skipped. The anchor
+ * moves to the last release due, so it stays within a period of the present.
+ * @param pTask Task just dispatched.
+ */
+static void uKernelPlanOnGrid(uKernelTaskDescriptor *pTask)
+{
+    uint32_t interval = pTask->userTasksInterval;
+    uint32_t late = _counterMs - pTask->plannedTask;
+
+    if (interval == 0)
+    {
+        pTask->plannedTask = _counterMs;
+        pTask->phaseAnchor = _counterMs;
+
+        return;
+    }
+
+    if ((int32_t) late < 0)
+    {
+        //released by an event before its time, the release stays due
+        return;
+    }
+
+    pTask->phaseAnchor = pTask->plannedTask + (late - (late % interval));
+    pTask->plannedTask = pTask->phaseAnchor + interval;
+}
+
+#endif
+
 bool uKernelModifyTask(uKernelTaskDescriptor *pTaskDescriptor,
                        uint32_t taskInterval,
                        uKernelTaskStatus tStatus)
@@ -169,11 +739,16 @@ bool uKernelModifyTask(uKernelTaskDescriptor *pTaskDescriptor,
     }
 
     pTaskDescriptor->userTasksInterval = taskInterval;
-    pTaskDescriptor->taskStatus = tStatus;
+    //as when adding, the IMMEDIATESTART bit only sets the first release
+    pTaskDescriptor->taskStatus = tStatus & 0x03;
 
-    if (tStatus == uKernel_SCHEDULED || tStatus == uKernel_ONETIME)
+    if (tStatus != uKernel_PAUSED)
     {
-        pTaskDescriptor->plannedTask = _counterMs + taskInterval;
+        pTaskDescriptor->plannedTask =
+                _counterMs + ((tStatus & 0x04) ? 0 : taskInterval);
+#if uKERNEL_USE_PHASE
+        pTaskDescriptor->phaseAnchor = pTaskDescriptor->plannedTask;
+#endif
     }
     else
     {
@@ -194,68 +769,2700 @@ uKernelTaskStatus uKernelGetTaskStatus(uKernelTaskDescriptor *pTaskDescriptor)
     return pTaskDescriptor->taskStatus;
 }
 
+#if uKERNEL_USE_START_TOGETHER
+
+bool uKernelStartTasksTogether(uKernelTaskDescriptor * const *pTasks,
+                               const uint32_t *pOffsets,
+                               uint8_t count,
+                               uint32_t delay,
+                               uKernelTaskStatus taskStatus)
+{
+    uint32_t start;
+    uint8_t i;
+
+    if ((_initialized == false) || (pTasks == NULL)
+            || (taskStatus == uKernel_PAUSED)
+            || (taskStatus > uKernel_ONETIME_IMMEDIATESTART))
+    {
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (pTasks[i] == NULL)
+        {
+            return false;
+        }
+    }
+
+    // One snapshot of the time for all the tasks
+    start = uKernelGetTime() + delay;
+
+    for (i = 0; i < count; i++)
+    {
+        pTasks[i]->plannedTask = start + ((pOffsets != NULL) ? pOffsets[i] : 0);
+#if uKERNEL_USE_PHASE
+        pTasks[i]->phaseAnchor = pTasks[i]->plannedTask;
+#endif
+        //the IMMEDIATESTART bit makes no sense here
+        pTasks[i]->taskStatus = taskStatus & 0x03;
+    }
+
+    return true;
+}
+
+#endif
+
+uint32_t uKernelGetTime(void)
+{
+    uint32_t time;
+
+    uKERNEL_DISABLE_INTERRUPTS();
+    time = _counterMs;
+    uKERNEL_ENABLE_INTERRUPTS();
+
+    return time;
+}
+
 /**
  * Scheduling. This runs the kernel itself.
  */
 void uKernelScheduler(void)
 {
+#if uKERNEL_USE_OVERHEAD
+    uKernelCycles passStart;
+
+#endif
     while (1)
     {
-        if (pTaskSchedule != NULL && _numberTasks != 0)
+#if uKERNEL_USE_OVERHEAD
+        passStart = uKERNEL_CYCLE_COUNTER();
+        _passBodyCycles = 0;
+        _passBusy = false;
+#endif
+
+        uKernelSchedulePass();
+
+        ClrWdt();
+
+#if uKERNEL_USE_OVERHEAD
+        uKernelAccountPass((uKernelCycles) (uKERNEL_CYCLE_COUNTER() - passStart));
+#endif
+#if uKERNEL_USE_ENERGY
+        //fold the time in before the 32 bits difference can wrap
+        if ((_counterMs - _energyMark) >= uKERNEL_ENERGY_FOLD_MS)
         {
-            //the task is running
-            if (pTaskSchedule->taskStatus > uKernel_PAUSED)
-            {
-                //this trick overrun the overflow of _counterMs
-                if ((int32_t) (_counterMs - pTaskSchedule->plannedTask) >= 0)
-                {
-                    if (pTaskSchedule->taskStatus & uKernel_ONETIME)
-                    {
-                        pTaskSchedule->taskPointer(); //call the task
-                        pTaskSchedule->taskStatus = uKernel_PAUSED; //pause the task
-                    }
-                    else
-                    {
-                        //let's schedule next start
-                        pTaskSchedule->plannedTask =
-                                _counterMs + pTaskSchedule->userTasksInterval;
-
-                        pTaskSchedule->taskPointer(); //call the task
-                    }
-                }
-            }
-            // If a task has called the function DeleteAllTask() and if no
-            // task are added, the pointer is null
-            if (pTaskSchedule != NULL)
-            {
-                // Set the scheduler pointer on the next task
-                pTaskSchedule = pTaskSchedule->pTaskNext;
-            }
+            _energyElapsedMs += _counterMs - _energyMark;
+            _energyMark = _counterMs;
         }
+#endif
+    }
+}
 
-        ClrWdt();
+static void uKernelSchedulePass(void)
+{
+#if uKERNEL_USE_SLEEP && uKERNEL_USE_ENERGY
+    uint32_t sleepStart;
+
+#endif
+#if uKERNEL_USE_READY_BITMAP
+    // Posted tasks go first, the lowest slot first
+    if (_readyBitmap != 0)
+    {
+        uKernelRunReady();
+    }
+
+#endif
+#if uKERNEL_USE_POST_QUEUE
+    if (uKERNEL_POST_HEAD(_coreId) != NULL)
+    {
+        uKernelRunPosted();
+    }
+
+#endif
+#if uKERNEL_USE_MULTICORE
+    if (_core[_coreId].pMigrateInbox != NULL)
+    {
+        uKernelRunMigrated();
+    }
+
+#endif
+    if (pTaskSchedule != NULL && _numberTasks != 0)
+    {
+        //the task has been released or is running and its time has come,
+        //this trick overrun the overflow of _counterMs
+        if ((uKERNEL_TASK_RELEASED(pTaskSchedule) ||
+                ((pTaskSchedule->taskStatus > uKernel_PAUSED) &&
+                 ((int32_t) (_counterMs - pTaskSchedule->plannedTask) >= 0)))
+                && uKERNEL_GROUP_ALLOWS(pTaskSchedule))
+        {
+            uKernelDispatch(pTaskSchedule);
+        }
+#if uKERNEL_USE_LOOKAHEAD
+        if ((pTaskSchedule != NULL)
+                && (pTaskSchedule->taskStatus > uKernel_PAUSED))
+        {
+            uKernelLookaheadInsert(pTaskSchedule);
+        }
+#endif
+        // If a task has called the function DeleteAllTask() and if no
+        // task are added, the pointer is null
+        if (pTaskSchedule != NULL)
+        {
+            // Set the scheduler pointer on the next task
+            pTaskSchedule = pTaskSchedule->pTaskNext;
+        }
+    }
+
+#if uKERNEL_USE_PASS_END
+    // A whole pass without anything to do gives a turn to the jobs, then
+    // to the background tasks
+    if (((pTaskSchedule == NULL) || (pTaskSchedule == pTaskFirst)
+            || (_numberTasks == 0))
+#if uKERNEL_USE_CALIBRATION
+            // no sleep, balancing or clock change from inside uKernelInit
+            && !_calibrating
+#endif
+            )
+    {
+#if uKERNEL_USE_LOOKAHEAD
+        uKernelLookaheadPublish();
+#endif
+#if uKERNEL_USE_MULTICORE
+        if ((_counterMs - _balanceStart) >= uKERNEL_BALANCE_MS)
+        {
+            uKernelBalance();
+        }
+#endif
+#if uKERNEL_USE_DVFS
+        if ((_counterMs - _dvfsWindowStart) >= uKERNEL_DVFS_WINDOW_MS)
+        {
+            uKernelScaleFrequency();
+        }
+#endif
+#if uKERNEL_USE_JOBS
+        if (_passIdle && (pJobFirst != NULL))
+        {
+            uKERNEL_BODY_START();
+            uKernelRunJob();
+            uKERNEL_BODY_END();
+            _passIdle = false;
+        }
+#endif
+#if uKERNEL_USE_BACKGROUND
+        if (_passIdle && (_numberBackgroundTasks != 0))
+        {
+            uKERNEL_BODY_START();
+            uKernelRunBackgroundTask();
+            uKERNEL_BODY_END();
+            _passIdle = false;
+        }
+#endif
+#if uKERNEL_USE_SLEEP
+        if (_passIdle)
+        {
+#if uKERNEL_USE_ENERGY
+            sleepStart = _counterMs;
+#endif
+            // Woken up by the next interrupt, the tick at the latest
+            uKERNEL_IDLE();
+#if uKERNEL_USE_ENERGY
+            _energySleepMs += _counterMs - sleepStart;
+#endif
+        }
+#endif
+#if uKERNEL_USE_IDLE
+        _passIdle = true;
+#endif
     }
+#endif
 }
 
-void uKernelDelayMiliseconds(uint16_t delay)
+/**Run one task, whichever way it was found ready.*/
+static void uKernelDispatch(uKernelTaskDescriptor *pTask)
 {
-    uint32_t newTime = _counterMs + delay;
-    while (_counterMs < newTime);
+#if uKERNEL_USE_TRACE
+    uKernelDispatchRecord *pRecord;
+#endif
+#if uKERNEL_MEASURE_RUN
+    uint32_t duration;
+#endif
+#if uKERNEL_USE_TIMESTAMPS || uKERNEL_USE_WATCH
+    uint32_t releaseMs;
+#endif
+#if uKERNEL_USE_EXEC_AVERAGE
+    uint16_t sample;
+#endif
+#if uKERNEL_USE_CORE_STATS
+    uKernelTaskStats *pStats;
+#endif
+
+#if uKERNEL_USE_TIMESTAMPS || uKERNEL_USE_WATCH
+    //a task that isn't due yet has been released by an event
+    releaseMs = pTask->plannedTask;
+    if ((pTask->taskStatus == uKernel_PAUSED)
+            || ((int32_t) (_counterMs - releaseMs) < 0))
+    {
+        releaseMs = _counterMs;
+    }
+#endif
+#if uKERNEL_USE_TIMESTAMPS
+    _taskReleaseMs = releaseMs;
+#endif
+#if uKERNEL_USE_EVENTS
+    pTask->taskReleased = false;
+#endif
+
+    if (pTask->taskStatus & uKernel_ONETIME)
+    {
+        //pause the task before the call so it can re-arm itself
+        pTask->taskStatus = uKernel_PAUSED;
+    }
+    else if (pTask->taskStatus != uKernel_PAUSED)
+    {
+#if uKERNEL_USE_PHASE
+        uKernelPlanOnGrid(pTask);
+#else
+        //let's schedule next start
+        pTask->plannedTask = _counterMs + pTask->userTasksInterval;
+#endif
+    }
+
+#if uKERNEL_USE_IDLE
+    _passIdle = false;
+#endif
+    pTaskRunning = pTask;
+#if uKERNEL_MEASURE_RUN || uKERNEL_USE_TIMESTAMPS
+    _taskStartMs = _counterMs;
+#endif
+
+#if uKERNEL_USE_TRACE
+    //record the dispatch before the call so a crash inside shows
+    pRecord = &_postMortem.record[_postMortem.next];
+    pRecord->startTime = _taskStartMs;
+    pRecord->duration = 0xFFFF;
+    pRecord->taskId = pTaskRunning->taskId;
+    _postMortem.next = (_postMortem.next + 1)
+            % uKERNEL_POSTMORTEM_RECORDS;
+    if (_postMortem.count < uKERNEL_POSTMORTEM_RECORDS)
+    {
+        _postMortem.count++;
+    }
+#endif
+#if uKERNEL_USE_BUDGET
+    uKERNEL_BUDGET(_coreId).startMs = _taskStartMs;
+    uKERNEL_BUDGET(_coreId).budget = pTaskRunning->executionBudget;
+    uKERNEL_BUDGET(_coreId).exceeded = false;
+    //the tick only looks at the budget once everything is set
+#if uKERNEL_USE_MULTICORE
+    __atomic_store_n(&uKERNEL_BUDGET(_coreId).armed,
+                     (pTaskRunning->executionBudget != 0), __ATOMIC_RELEASE);
+#else
+    uKERNEL_BUDGET(_coreId).armed = (pTaskRunning->executionBudget != 0);
+#endif
+#endif
+
+    uKERNEL_BODY_START();
+    pTaskRunning->taskPointer(); //call the task
+    uKERNEL_BODY_END();
+
+#if uKERNEL_USE_BUDGET
+    uKERNEL_BUDGET(_coreId).armed = false;
+#endif
+#if uKERNEL_MEASURE_RUN
+    duration = _counterMs - _taskStartMs;
+#endif
+#if uKERNEL_USE_TRACE
+    pRecord->duration = (duration < 0xFFFF) ?
+            (uint16_t) duration : 0xFFFE;
+#endif
+#if uKERNEL_USE_BUDGET
+    if (uKERNEL_BUDGET(_coreId).budget != 0)
+    {
+        uKernelCheckBudget(pTaskRunning, duration);
+    }
+#endif
+#if uKERNEL_USE_WATCH
+    uKernelWatchUpdate(pTaskRunning->taskId,
+                       _taskStartMs - releaseMs, duration);
+#endif
+#if uKERNEL_USE_GROUPS
+    if (pTaskRunning->pGroup != NULL)
+    {
+        uKernelGroupCharge(pTaskRunning->pGroup, duration);
+    }
+#endif
+#if uKERNEL_USE_MULTICORE
+    _balanceBusyMs += duration;
+#endif
+#if uKERNEL_USE_DVFS
+    _dvfsBusyMs += duration;
+#endif
+#if uKERNEL_USE_EXEC_AVERAGE
+    //running average over about 8 runs, kept 8 times over in 1/16 ms so
+    //the fraction isn't lost and it goes down to 0 when the task does
+    sample = (duration < uKERNEL_EXECUTION_MAX_MS) ?
+            (uint16_t) (duration << (uKERNEL_EXECUTION_SHIFT - 3)) :
+            (uKERNEL_EXECUTION_MAX_MS << (uKERNEL_EXECUTION_SHIFT - 3));
+    pTaskRunning->executionAverage = pTaskRunning->executionAverage
+            - ((pTaskRunning->executionAverage + 7) >> 3) + sample;
+#endif
+#if uKERNEL_USE_ENERGY
+    pTaskRunning->activeMs += duration;
+    _energyTaskMs += duration;
+#endif
+#if uKERNEL_USE_CORE_STATS
+    if (pTaskRunning->taskId < uKERNEL_STATS_TASKS)
+    {
+        pStats = &_coreStats[_coreId].task[pTaskRunning->taskId];
+        pStats->runCount++;
+        pStats->busyMs += duration;
+        if (duration > pStats->maxExecution)
+        {
+            pStats->maxExecution = duration;
+        }
+    }
+#endif
+
+    pTaskRunning = NULL;
 }
 
-uint8_t uKernelSetTask(uKernelTaskDescriptor *pTaskDescriptor,
-                       uint32_t taskInterval,
-                       uKernelTaskStatus tStatus)
+#if uKERNEL_USE_TIMESTAMPS
+
+uint32_t uKernelGetReleaseTime(void)
 {
-    if ((_initialized == false) || (_numberTasks == MAX_TASKS_NUMBER)
-            || (pTaskDescriptor == NULL))
+    return _taskReleaseMs;
+}
+
+uint32_t uKernelGetStartTime(void)
+{
+    return _taskStartMs;
+}
+
+#endif
+
+void uKernelTick(void)
+{
+#if uKERNEL_USE_BUDGET
+    struct uKernelRunningBudget *pBudget;
+#if uKERNEL_USE_MULTICORE
+    uint8_t core;
+#endif
+
+#endif
+    _counterMs++;
+
+#if uKERNEL_USE_BUDGET
+#if uKERNEL_USE_MULTICORE
+    // Only one core ticks, it looks at the task running on each of them
+    for (core = 0; core < uKERNEL_CORES; core++)
+#endif
+    {
+        pBudget = &uKERNEL_BUDGET(core);
+#if uKERNEL_USE_MULTICORE
+        if (__atomic_load_n(&pBudget->armed, __ATOMIC_ACQUIRE)
+#else
+        if (pBudget->armed
+#endif
+                && !pBudget->exceeded
+                && ((_counterMs - pBudget->startMs) > pBudget->budget))
+        {
+            pBudget->exceeded = true;
+        }
+    }
+#endif
+}
+
+#if uKERNEL_USE_BUDGET
+
+bool uKernelSetTaskBudget(uKernelTaskDescriptor *pTaskDescriptor,
+                          uint16_t budget,
+                          bool demote)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
     {
         return false;
     }
 
-    pTaskDescriptor->taskStatus = tStatus;
+    pTaskDescriptor->executionBudget = budget;
+    pTaskDescriptor->budgetStrikes = demote ? uKERNEL_BUDGET_DEMOTE : 0;
+
+    return true;
+}
+
+bool uKernelBudgetExceeded(void)
+{
+    return (uKERNEL_BUDGET(_coreId).exceeded != false);
+}
+
+uint16_t uKernelGetBudgetViolations(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if (pTaskDescriptor == NULL)
+    {
+        return 0;
+    }
+
+    return pTaskDescriptor->budgetViolations;
+}
+
+static void uKernelCheckBudget(uKernelTaskDescriptor *pTaskDescriptor,
+                               uint32_t duration)
+{
+    uint8_t strikes = pTaskDescriptor->budgetStrikes & uKERNEL_BUDGET_STRIKES;
+
+    //the tick may not be used, so check again once the body is done
+    if (!uKERNEL_BUDGET(_coreId).exceeded
+            && (duration <= uKERNEL_BUDGET(_coreId).budget))
+    {
+        pTaskDescriptor->budgetStrikes &= uKERNEL_BUDGET_DEMOTE;
 
-    if (tStatus == uKernel_SCHEDULED)
+        return;
+    }
+
+    pTaskDescriptor->budgetViolations++;
+
+    if (strikes < uKERNEL_BUDGET_STRIKES)
+    {
+        strikes++;
+    }
+
+    pTaskDescriptor->budgetStrikes =
+            (pTaskDescriptor->budgetStrikes & uKERNEL_BUDGET_DEMOTE) | strikes;
+
+    //repeat offenders skip one period to give the time back to the others
+    if ((pTaskDescriptor->budgetStrikes & uKERNEL_BUDGET_DEMOTE)
+            && (strikes >= uKERNEL_BUDGET_DEMOTE_STRIKES)
+            && (pTaskDescriptor->taskStatus == uKernel_SCHEDULED))
+    {
+        pTaskDescriptor->plannedTask += pTaskDescriptor->userTasksInterval;
+    }
+}
+
+#endif
+
+#if uKERNEL_USE_BACKGROUND
+
+bool uKernelAddBackgroundTask(uKernelBackgroundTask *pBackgroundTask,
+                              void (*userTask)(void),
+                              uint16_t weight)
+{
+    if ((_initialized == false) || (pBackgroundTask == NULL) || (userTask == NULL)
+            || (weight == 0)
+            || (_numberBackgroundTasks == uKERNEL_MAX_BACKGROUND_TASKS))
+    {
+        return false;
+    }
+
+    pBackgroundTask->taskPointer = userTask;
+    pBackgroundTask->stride = uKERNEL_STRIDE_ONE / weight;
+    // Join at the current minimum so a new task doesn't take the whole share
+    pBackgroundTask->pass =
+            (_numberBackgroundTasks != 0) ? pBackgroundHeap[0]->pass : 0;
+    pBackgroundTask->heapIndex = _numberBackgroundTasks;
+
+    pBackgroundHeap[_numberBackgroundTasks] = pBackgroundTask;
+    _numberBackgroundTasks++;
+    uKernelHeapSiftUp(pBackgroundTask->heapIndex);
+
+    return true;
+}
+
+bool uKernelRemoveBackgroundTask(uKernelBackgroundTask *pBackgroundTask)
+{
+    uint8_t index;
+
+    if ((_initialized == false) || (pBackgroundTask == NULL)
+            || (pBackgroundTask->heapIndex >= _numberBackgroundTasks)
+            || (pBackgroundHeap[pBackgroundTask->heapIndex] != pBackgroundTask))
+    {
+        return false;
+    }
+
+    // Move the last task in the hole and restore the heap order from there
+    index = pBackgroundTask->heapIndex;
+    _numberBackgroundTasks--;
+
+    if (index != _numberBackgroundTasks)
+    {
+        pBackgroundHeap[index] = pBackgroundHeap[_numberBackgroundTasks];
+        pBackgroundHeap[index]->heapIndex = index;
+        uKernelHeapSiftUp(index);
+        uKernelHeapSiftDown(pBackgroundHeap[index]->heapIndex);
+    }
+
+    pBackgroundTask->heapIndex = uKERNEL_MAX_BACKGROUND_TASKS;
+
+    return true;
+}
+
+static void uKernelRunBackgroundTask(void)
+{
+    uKernelBackgroundTask *pBackgroundTask = pBackgroundHeap[0];
+
+    // Advance the pass before the call, the body may remove the task
+    pBackgroundTask->pass += pBackgroundTask->stride;
+    uKernelHeapSiftDown(0);
+
+    pBackgroundTask->taskPointer();
+}
+
+static void uKernelHeapSiftUp(uint8_t index)
+{
+    uKernelBackgroundTask *pBackgroundTask = pBackgroundHeap[index];
+    uint8_t parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1) >> 1;
+
+        //compare the difference so the pass values can overflow
+        if ((int32_t) (pBackgroundTask->pass - pBackgroundHeap[parent]->pass) >= 0)
+        {
+            break;
+        }
+
+        pBackgroundHeap[index] = pBackgroundHeap[parent];
+        pBackgroundHeap[index]->heapIndex = index;
+        index = parent;
+    }
+
+    pBackgroundHeap[index] = pBackgroundTask;
+    pBackgroundTask->heapIndex = index;
+}
+
+static void uKernelHeapSiftDown(uint8_t index)
+{
+    uKernelBackgroundTask *pBackgroundTask = pBackgroundHeap[index];
+    uint8_t child;
+
+    while ((child = (index << 1) + 1) < _numberBackgroundTasks)
+    {
+        if (((child + 1) < _numberBackgroundTasks)
+                && ((int32_t) (pBackgroundHeap[child + 1]->pass
+                               - pBackgroundHeap[child]->pass) < 0))
+        {
+            child++;
+        }
+
+        if ((int32_t) (pBackgroundHeap[child]->pass - pBackgroundTask->pass) >= 0)
+        {
+            break;
+        }
+
+        pBackgroundHeap[index] = pBackgroundHeap[child];
+        pBackgroundHeap[index]->heapIndex = index;
+        index = child;
+    }
+
+    pBackgroundHeap[index] = pBackgroundTask;
+    pBackgroundTask->heapIndex = index;
+}
+
+#endif
+
+#if uKERNEL_USE_JOBS
+
+bool uKernelSubmitJob(uKernelJob *pJob,
+                      JobStep jobStep,
+                      void *pState,
+                      uKernelTaskDescriptor *pNotifyTask)
+{
+    uKernelJob **ppWork;
+
+    if ((_initialized == false) || (pJob == NULL) || (jobStep == NULL))
+    {
+        return false;
+    }
+
+    pJob->stepPointer = jobStep;
+    pJob->pState = pState;
+    pJob->progress = 0;
+    pJob->done = false;
+    pJob->pNotifyTask = pNotifyTask;
+    pJob->pNext = NULL;
+
+    // Jobs run in the order they were queued
+    for (ppWork = &pJobFirst; *ppWork != NULL; ppWork = &(*ppWork)->pNext)
+    {
+        if (*ppWork == pJob)
+        {
+            return false;
+        }
+    }
+
+    *ppWork = pJob;
+
+    return true;
+}
+
+bool uKernelCancelJob(uKernelJob *pJob)
+{
+    uKernelJob **ppWork;
+
+    for (ppWork = &pJobFirst; *ppWork != NULL; ppWork = &(*ppWork)->pNext)
+    {
+        if (*ppWork == pJob)
+        {
+            *ppWork = pJob->pNext;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t uKernelGetJobProgress(uKernelJob *pJob)
+{
+    if (pJob == NULL)
+    {
+        return 0;
+    }
+
+    return pJob->done ? 100 : pJob->progress;
+}
+
+static void uKernelRunJob(void)
+{
+    uKernelJob *pJob = pJobFirst;
+    uint32_t start = _counterMs;
+    uint32_t budget = uKernelGetSlack();
+    bool done;
+
+    // At least one step, then as many as fit in the slack
+    do
+    {
+        done = pJob->stepPointer(pJob);
+    }
+    while (!done && ((_counterMs - start) < budget));
+
+    if (done)
+    {
+        pJobFirst = pJob->pNext;
+        pJob->pNext = NULL;
+        pJob->progress = 100;
+        pJob->done = true;
+
+        if (pJob->pNotifyTask != NULL)
+        {
+            pJob->pNotifyTask->taskReleased = true;
+        }
+    }
+}
+
+static uint32_t uKernelGetSlack(void)
+{
+    uint32_t slack = uKERNEL_JOB_MAX_CHUNK_MS + uKERNEL_JOB_GUARD_MS;
+    int32_t untilRelease;
+    uKernelTaskDescriptor *pTaskWork = pTaskFirst;
+    uint8_t i;
+
+    // Posted work runs on the next pass whatever the releases say
+#if uKERNEL_USE_READY_BITMAP
+    if (_readyBitmap != 0)
+    {
+        return 0;
+    }
+
+#endif
+#if uKERNEL_USE_POST_QUEUE
+    if (uKERNEL_POST_HEAD(_coreId) != NULL)
+    {
+        return 0;
+    }
+
+#endif
+#if uKERNEL_USE_MULTICORE
+    if (_core[_coreId].pMigrateInbox != NULL)
+    {
+        return 0;
+    }
+
+#endif
+    // Time until the closest release of a running task
+    for (i = 0; (i < _numberTasks) && (pTaskWork != NULL); i++)
+    {
+        if (pTaskWork->taskReleased)
+        {
+            return 0;
+        }
+#if !uKERNEL_USE_LOOKAHEAD
+
+        if (pTaskWork->taskStatus > uKernel_PAUSED)
+        {
+            untilRelease = (int32_t) (pTaskWork->plannedTask - _counterMs);
+
+            if (untilRelease <= 0)
+            {
+                return 0;
+            }
+
+            if ((uint32_t) untilRelease < slack)
+            {
+                slack = (uint32_t) untilRelease;
+            }
+        }
+#endif
+
+        pTaskWork = pTaskWork->pTaskNext;
+    }
+#if uKERNEL_USE_LOOKAHEAD
+
+    // The lookahead of the pass just finished already has the closest release
+    if (_lookaheadCount != 0)
+    {
+        untilRelease = (int32_t) (_lookahead[0].releaseTime - _counterMs);
+
+        if (untilRelease <= 0)
+        {
+            return 0;
+        }
+
+        if ((uint32_t) untilRelease < slack)
+        {
+            slack = (uint32_t) untilRelease;
+        }
+    }
+#endif
+
+    return (slack > uKERNEL_JOB_GUARD_MS) ? slack - uKERNEL_JOB_GUARD_MS : 0;
+}
+
+#endif
+
+#if uKERNEL_USE_LOOKAHEAD
+
+uint8_t uKernelGetNextReleases(uKernelRelease *pReleases, uint8_t maxReleases)
+{
+    uKernelRelease next[uKERNEL_LOOKAHEAD_DEPTH];
+    uint8_t count = _lookaheadCount;
+    uint8_t found = 0;
+    uint8_t earliest;
+    uint8_t i;
+
+    if (pReleases == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        next[i] = _lookahead[i];
+    }
+
+    // Merge the releases of the tasks kept, a periodic one comes back every
+    // period, as long as no task left out of the lookahead can come first
+    while ((found < maxReleases) && (count != 0))
+    {
+        earliest = 0;
+        for (i = 1; i < count; i++)
+        {
+            if ((int32_t) (next[i].releaseTime
+                           - next[earliest].releaseTime) < 0)
+            {
+                earliest = i;
+            }
+        }
+
+        if (!uKernelLookaheadSure(next[earliest].releaseTime))
+        {
+            break;
+        }
+
+        pReleases[found++] = next[earliest];
+
+        if (uKernelLookaheadPeriod(next[earliest].pTask) != 0)
+        {
+            next[earliest].releaseTime +=
+                    uKernelLookaheadPeriod(next[earliest].pTask);
+        }
+        else
+        {
+            next[earliest] = next[--count];
+        }
+    }
+
+    return found;
+}
+
+bool uKernelGetEarliestRelease(uint32_t after, uKernelRelease *pRelease)
+{
+    uKernelRelease release;
+    uint32_t period;
+    uint32_t late;
+    bool found = false;
+    uint8_t i;
+
+    if (pRelease == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < _lookaheadCount; i++)
+    {
+        release = _lookahead[i];
+        late = after - release.releaseTime;
+        period = uKernelLookaheadPeriod(release.pTask);
+
+        if ((int32_t) late > 0)
+        {
+            if (period == 0)
+            {
+                continue;
+            }
+
+            // First release of its period at or after the time asked
+            release.releaseTime += ((late + period - 1) / period) * period;
+        }
+
+        if (!found || ((int32_t) (release.releaseTime
+                                  - pRelease->releaseTime) < 0))
+        {
+            *pRelease = release;
+            found = true;
+        }
+    }
+
+    return found && uKernelLookaheadSure(pRelease->releaseTime);
+}
+
+/**
+ * Get the period a task of the lookahead comes back with.
+ * @param pTaskDescriptor Task of the release.
+ * @return The period, 0 if the task is not periodic.
+ */
+static uint32_t uKernelLookaheadPeriod(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((pTaskDescriptor->taskStatus == uKernel_PAUSED)
+            || (pTaskDescriptor->taskStatus & uKernel_ONETIME))
+    {
+        return 0;
+    }
+
+    return pTaskDescriptor->userTasksInterval;
+}
+
+/**
+ * Tell if no task left out of the lookahead can be released before a time.
+ * When the lookahead is full the tasks left out are released after its last
+ * release, so only up to it the releases are known.
+ * @param releaseTime Time of the release.
+ * @return Return true if no release can come before it unseen.
+ */
+static bool uKernelLookaheadSure(uint32_t releaseTime)
+{
+    return (_lookaheadCount < uKERNEL_LOOKAHEAD_DEPTH)
+            || ((int32_t) (releaseTime
+                           - _lookahead[uKERNEL_LOOKAHEAD_DEPTH - 1].releaseTime) <= 0);
+}
+
+static void uKernelLookaheadInsert(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    uint32_t releaseTime = pTaskDescriptor->plannedTask;
+    uint8_t i = _lookaheadWorkCount;
+
+    // Later than all the ones kept, nothing to do
+    if ((i == uKERNEL_LOOKAHEAD_DEPTH)
+            && ((int32_t) (releaseTime - _lookaheadWork[i - 1].releaseTime) >= 0))
+    {
+        return;
+    }
+
+    if (i < uKERNEL_LOOKAHEAD_DEPTH)
+    {
+        _lookaheadWorkCount++;
+    }
+    else
+    {
+        i--;
+    }
+
+    // Shift the later releases down to keep the array sorted
+    while ((i > 0)
+            && ((int32_t) (releaseTime - _lookaheadWork[i - 1].releaseTime) < 0))
+    {
+        _lookaheadWork[i] = _lookaheadWork[i - 1];
+        i--;
+    }
+
+    _lookaheadWork[i].releaseTime = releaseTime;
+    _lookaheadWork[i].pTask = pTaskDescriptor;
+}
+
+static void uKernelLookaheadPublish(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < _lookaheadWorkCount; i++)
+    {
+        _lookahead[i] = _lookaheadWork[i];
+    }
+
+    _lookaheadCount = _lookaheadWorkCount;
+    _lookaheadWorkCount = 0;
+}
+
+#endif
+
+#if uKERNEL_USE_CALIBRATION
+
+const uKernelOverhead *uKernelGetOverhead(void)
+{
+    return &_overhead;
+}
+
+static void uKernelCalibrate(void)
+{
+    static uKERNEL_CORE_LOCAL uKernelTaskDescriptor calibrationTask;
+    uKernelCycles start;
+    uKernelCycles elapsed;
+    uKernelCycles dispatchPass;
+    uint8_t i;
+#if uKERNEL_USE_TRACE
+    uint8_t next = _postMortem.next;
+    uint8_t count = _postMortem.count;
+    uKernelDispatchRecord record = _postMortem.record[next];
+#endif
+
+    // Keep the shortest of the runs, the others were hit by interrupts
+    _calibrating = true;
+    _overhead.addRemove = (uKernelCycles) ~0;
+    _overhead.schedulerPass = (uKernelCycles) ~0;
+    dispatchPass = (uKernelCycles) ~0;
+
+    for (i = 0; i < uKERNEL_CALIBRATION_RUNS; i++)
+    {
+        start = uKERNEL_CYCLE_COUNTER();
+        uKernelAddTask(&calibrationTask, uKernelCalibrationBody,
+                       MAX_TASK_INTERVAL, uKernel_PAUSED);
+        uKernelRemoveTask(&calibrationTask);
+        elapsed = (uKernelCycles) (uKERNEL_CYCLE_COUNTER() - start);
+
+        if (elapsed < _overhead.addRemove)
+        {
+            _overhead.addRemove = elapsed;
+        }
+
+        pTaskFirst = NULL;
+        pTaskSchedule = NULL;
+    }
+
+    uKernelAddTask(&calibrationTask, uKernelCalibrationBody,
+                   MAX_TASK_INTERVAL, uKernel_PAUSED);
+#if uKERNEL_USE_TASK_ID
+    // Its runs must not count in the statistics of the task getting its id
+    uKernelTaskIdFree(calibrationTask.taskId);
+    calibrationTask.taskId = uKERNEL_NO_TASK_ID;
+#endif
+
+    for (i = 0; i < uKERNEL_CALIBRATION_RUNS; i++)
+    {
+        // A pass over a paused task
+        calibrationTask.taskStatus = uKernel_PAUSED;
+        start = uKERNEL_CYCLE_COUNTER();
+        uKernelSchedulePass();
+        elapsed = (uKernelCycles) (uKERNEL_CYCLE_COUNTER() - start);
+
+        if (elapsed < _overhead.schedulerPass)
+        {
+            _overhead.schedulerPass = elapsed;
+        }
+
+        // A pass that dispatches the task, with an empty body
+        calibrationTask.taskStatus = uKernel_SCHEDULED;
+        calibrationTask.plannedTask = _counterMs;
+        start = uKERNEL_CYCLE_COUNTER();
+        uKernelSchedulePass();
+        elapsed = (uKernelCycles) (uKERNEL_CYCLE_COUNTER() - start);
+
+        if (elapsed < dispatchPass)
+        {
+            dispatchPass = elapsed;
+        }
+#if uKERNEL_USE_TRACE
+
+        // Don't let the calibration overwrite the ring of the previous run
+        _postMortem.next = next;
+        _postMortem.count = count;
+        _postMortem.record[next] = record;
+#endif
+    }
+
+    _overhead.dispatch = (dispatchPass > _overhead.schedulerPass) ?
+            dispatchPass - _overhead.schedulerPass : 0;
+
+    // Leave the kernel as if nothing happened
+    _calibrating = false;
+    pTaskFirst = NULL;
+    pTaskSchedule = NULL;
+    _numberTasks = 0;
+#if uKERNEL_USE_IDLE
+    _passIdle = true;
+#endif
+#if uKERNEL_USE_LOOKAHEAD
+    _lookaheadCount = 0;
+    _lookaheadWorkCount = 0;
+#endif
+#if uKERNEL_USE_READY_BITMAP
+    uKernelReadyReset();
+#endif
+}
+
+static void uKernelCalibrationBody(void)
+{
+}
+
+#endif
+
+#if uKERNEL_USE_OVERHEAD
+
+bool uKernelGetCpuLoad(uKernelCpuLoad *pLoad)
+{
+    if ((pLoad == NULL) || (_cpuLoadValid == false))
+    {
+        return false;
+    }
+
+    *pLoad = _cpuLoad;
+
+    return true;
+}
+
+static void uKernelAccountPass(uKernelCycles passCycles)
+{
+    uint32_t total;
+#if uKERNEL_USE_CALIBRATION
+    uKernelCycles visitCycles;
+#endif
+
+    if (_passBusy)
+    {
+        _taskCycles += _passBodyCycles;
+        _kernelCycles += (passCycles > _passBodyCycles) ?
+                passCycles - _passBodyCycles : 0;
+    }
+    else
+    {
+#if uKERNEL_USE_CALIBRATION
+        // The pass still visited a task, only what is left is spin or sleep
+        visitCycles = (passCycles > _overhead.schedulerPass) ?
+                _overhead.schedulerPass : passCycles;
+        _kernelCycles += visitCycles;
+        passCycles -= visitCycles;
+#endif
+        _idleCycles += passCycles;
+    }
+
+    if ((_counterMs - _windowStart) < uKERNEL_OVERHEAD_WINDOW_MS)
+    {
+        return;
+    }
+
+    // Divide the total first so the per-mille can't overflow 32 bits
+    total = (_kernelCycles + _taskCycles + _idleCycles) / 1000;
+
+    if (total != 0)
+    {
+        _cpuLoad.kernelPermille = (uint16_t) (_kernelCycles / total);
+        _cpuLoad.taskPermille = (uint16_t) (_taskCycles / total);
+        _cpuLoad.idlePermille = (uint16_t) (_idleCycles / total);
+        _cpuLoadValid = true;
+#if uKERNEL_USE_WATCH
+        //odd while the block is being written, as in uKernelWatchUpdate
+        uKernelWatch.sequence++;
+        uKernelWatch.cpuLoadPermille = (_cpuLoad.idlePermille < 1000) ?
+                1000 - _cpuLoad.idlePermille : 0;
+        uKernelWatch.sequence++;
+#endif
+    }
+
+    _kernelCycles = 0;
+    _taskCycles = 0;
+    _idleCycles = 0;
+    _windowStart = _counterMs;
+}
+
+#endif
+
+#if uKERNEL_USE_MULTICORE
+
+bool uKernelPinTask(uKernelTaskDescriptor *pTaskDescriptor, bool pinned)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    pTaskDescriptor->taskPinned = pinned;
+
+    return true;
+}
+
+bool uKernelMigrateTask(uKernelTaskDescriptor *pTaskDescriptor, uint8_t core)
+{
+    uKernelTaskDescriptor *pHead;
+
+    // Only the owner core touches its list
+    if ((_initialized == false) || (pTaskDescriptor == NULL)
+            || (core >= uKERNEL_CORES) || (core == _coreId)
+            || (pTaskDescriptor->taskCore != _coreId)
+            || (pTaskDescriptor == pTaskRunning)
+            || pTaskDescriptor->taskPinned)
+    {
+        return false;
+    }
+
+    uKernelUnlinkTask(pTaskDescriptor);
+
+    // Posts made from now on go to the new core
+    __atomic_store_n(&pTaskDescriptor->taskCore, core, __ATOMIC_RELEASE);
+
+    pHead = __atomic_load_n(&_core[core].pMigrateInbox, __ATOMIC_RELAXED);
+    do
+    {
+        pTaskDescriptor->pTaskNext = pHead;
+    }
+    while (!__atomic_compare_exchange_n(&_core[core].pMigrateInbox, &pHead,
+                                        pTaskDescriptor, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return true;
+}
+
+uint8_t uKernelGetTaskCore(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    return (pTaskDescriptor != NULL) ? pTaskDescriptor->taskCore : 0;
+}
+
+uint16_t uKernelGetCoreLoad(uint8_t core)
+{
+    return (core < uKERNEL_CORES) ? _core[core].load : 0;
+}
+
+#if uKERNEL_USE_CORE_STATS
+
+bool uKernelGetTaskStats(uKernelTaskDescriptor *pTaskDescriptor,
+                         uKernelTaskStats *pStats)
+{
+    const uKernelTaskStats *pShard;
+    uint8_t i;
+
+    if ((pTaskDescriptor == NULL) || (pStats == NULL)
+            || (pTaskDescriptor->taskId >= uKERNEL_STATS_TASKS))
+    {
+        return false;
+    }
+
+    pStats->runCount = 0;
+    pStats->busyMs = 0;
+    pStats->maxExecution = 0;
+
+    // A task moved between cores has a part of its history in each shard
+    for (i = 0; i < uKERNEL_CORES; i++)
+    {
+        pShard = &_coreStats[i].task[pTaskDescriptor->taskId];
+        pStats->runCount += pShard->runCount;
+        pStats->busyMs += pShard->busyMs;
+        if (pShard->maxExecution > pStats->maxExecution)
+        {
+            pStats->maxExecution = pShard->maxExecution;
+        }
+    }
+
+    return true;
+}
+
+#endif
+
+static void uKernelUnlinkTask(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    uKernelTaskDescriptor *pTaskPrevious = pTaskDescriptor;
+
+    if (_numberTasks == 1)
+    {
+        pTaskFirst = NULL;
+        pTaskSchedule = NULL;
+    }
+    else
+    {
+        while (pTaskPrevious->pTaskNext != pTaskDescriptor)
+        {
+            pTaskPrevious = pTaskPrevious->pTaskNext;
+        }
+        pTaskPrevious->pTaskNext = pTaskDescriptor->pTaskNext;
+
+        if (pTaskFirst == pTaskDescriptor)
+        {
+            pTaskFirst = pTaskDescriptor->pTaskNext;
+        }
+        if (pTaskSchedule == pTaskDescriptor)
+        {
+            pTaskSchedule = pTaskDescriptor->pTaskNext;
+        }
+    }
+#if uKERNEL_USE_READY_BITMAP
+    uKernelReadyFree(pTaskDescriptor);
+#endif
+
+    _numberTasks--;
+}
+
+static void uKernelRunMigrated(void)
+{
+    uKernelTaskDescriptor *pList;
+    uKernelTaskDescriptor *pNext;
+
+    pList = __atomic_exchange_n(&_core[_coreId].pMigrateInbox, NULL, __ATOMIC_ACQUIRE);
+
+    // The task keeps its planned time, the time base is shared
+    while (pList != NULL)
+    {
+        pNext = pList->pTaskNext;
+
+        uKernelLinkTask(pList);
+#if uKERNEL_USE_READY_BITMAP
+        pList->readySlot = uKernelReadyAlloc(pList);
+#endif
+        _numberTasks++;
+
+        pList = pNext;
+    }
+}
+
+static void uKernelBalance(void)
+{
+    uKernelTaskDescriptor *pTaskWork;
+    uKernelTaskDescriptor *pCandidate = NULL;
+    uint32_t window = _counterMs - _balanceStart;
+    uint32_t load;
+    uint32_t utilization;
+    uint32_t best = 0;
+    uint16_t share;
+    uint8_t target = _coreId;
+    uint8_t i;
+
+    load = (_balanceBusyMs >= window) ? 1000 : (_balanceBusyMs * 1000) / window;
+    _core[_coreId].load = (uint16_t) load;
+    _balanceStart = _counterMs;
+    _balanceBusyMs = 0;
+
+    for (i = 0; i < uKERNEL_CORES; i++)
+    {
+        if (_core[i].load < _core[target].load)
+        {
+            target = i;
+        }
+    }
+
+    if ((target == _coreId) || (pTaskFirst == NULL)
+            || (load <= (uint32_t) _core[target].load + uKERNEL_BALANCE_MARGIN))
+    {
+        return;
+    }
+
+    // Move the biggest task that doesn't make the target the busiest
+    share = (uint16_t) ((load - _core[target].load) / 2);
+    pTaskWork = pTaskFirst;
+    do
+    {
+        //a zero interval can be given with uKernelModifyTask
+        if ((pTaskWork->taskStatus == uKernel_SCHEDULED)
+                && (pTaskWork->userTasksInterval != 0)
+                && !pTaskWork->taskPinned
+#if uKERNEL_USE_GROUPS
+                && (pTaskWork->pGroup == NULL)
+#endif
+                )
+        {
+            //permille of the CPU
+            utilization = uKERNEL_EXECUTION_US(pTaskWork)
+                    / pTaskWork->userTasksInterval;
+            if ((utilization > best) && (utilization <= share))
+            {
+                best = utilization;
+                pCandidate = pTaskWork;
+            }
+        }
+        pTaskWork = pTaskWork->pTaskNext;
+    }
+    while (pTaskWork != pTaskFirst);
+
+    if ((pCandidate != NULL) && uKernelMigrateTask(pCandidate, target))
+    {
+        // Don't let the other cores pick the same target before it measures
+        _core[_coreId].load = (uint16_t) (load - best);
+        _core[target].load += (uint16_t) best;
+    }
+}
+
+#endif
+
+#if uKERNEL_USE_ENERGY
+
+bool uKernelGetEnergy(uKernelEnergy *pEnergy)
+{
+    if ((_initialized == false) || (pEnergy == NULL))
+    {
+        return false;
+    }
+
+    pEnergy->elapsedMs = uKernelEnergyElapsed();
+    pEnergy->taskMs = _energyTaskMs;
+    pEnergy->sleepMs = _energySleepMs;
+    // Whatever isn't sleep is spent awake, in the tasks or not
+    pEnergy->energyUj = uKernelEnergyUj(pEnergy->elapsedMs - pEnergy->sleepMs,
+                                        pEnergy->sleepMs);
+    pEnergy->perHourUj = uKernelPerHour(pEnergy->energyUj, pEnergy->elapsedMs);
+
+    return true;
+}
+
+uint64_t uKernelGetTaskEnergy(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if (pTaskDescriptor == NULL)
+    {
+        return 0;
+    }
+
+    return uKernelEnergyUj(pTaskDescriptor->activeMs, 0);
+}
+
+uint64_t uKernelGetTaskEnergyPerHour(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if (pTaskDescriptor == NULL)
+    {
+        return 0;
+    }
+
+    return uKernelPerHour(uKernelEnergyUj(pTaskDescriptor->activeMs, 0),
+                          uKernelEnergyElapsed());
+}
+
+void uKernelResetEnergy(void)
+{
+    uKernelTaskDescriptor *pTaskWork = pTaskFirst;
+
+    _energyMark = _counterMs;
+    _energyElapsedMs = 0;
+    _energyTaskMs = 0;
+    _energySleepMs = 0;
+
+    if (pTaskWork != NULL)
+    {
+        do
+        {
+            pTaskWork->activeMs = 0;
+            pTaskWork = pTaskWork->pTaskNext;
+        }
+        while (pTaskWork != pTaskFirst);
+    }
+}
+
+static uint64_t uKernelEnergyElapsed(void)
+{
+    return _energyElapsedMs + (uint32_t) (_counterMs - _energyMark);
+}
+
+static uint64_t uKernelEnergyUj(uint64_t activeMs, uint64_t sleepMs)
+{
+    // Power in uW times milliseconds gives nJ
+    return (activeMs * uKERNEL_ACTIVE_POWER_UW
+            + sleepMs * uKERNEL_SLEEP_POWER_UW) / 1000;
+}
+
+static uint64_t uKernelPerHour(uint64_t energy, uint64_t elapsed)
+{
+    if (elapsed == 0)
+    {
+        return 0;
+    }
+
+    return (energy * 3600000UL) / elapsed;
+}
+
+#endif
+
+#if uKERNEL_USE_DVFS
+
+uint8_t uKernelGetFrequencyLevel(void)
+{
+    return _dvfsLevel;
+}
+
+uint16_t uKernelGetRequiredUtilization(void)
+{
+    return _dvfsRequired;
+}
+
+static void uKernelScaleFrequency(void)
+{
+    uKernelTaskDescriptor *pTaskWork = pTaskFirst;
+    uint32_t window = _counterMs - _dvfsWindowStart;
+    uint32_t predicted = 0;
+    uint32_t measured;
+    uint8_t level;
+
+    // What the periodic tasks will ask for, from their average run
+    if (pTaskWork != NULL)
+    {
+        do
+        {
+            //a zero interval can be given with uKernelModifyTask
+            if ((pTaskWork->taskStatus == uKernel_SCHEDULED)
+                    && (pTaskWork->userTasksInterval != 0))
+            {
+                predicted += uKERNEL_EXECUTION_US(pTaskWork)
+                        / pTaskWork->userTasksInterval;
+            }
+            pTaskWork = pTaskWork->pTaskNext;
+        }
+        while (pTaskWork != pTaskFirst);
+    }
+
+    // The event driven tasks only show in the measured load
+    measured = (_dvfsBusyMs >= window) ? 1000 : (_dvfsBusyMs * 1000) / window;
+    if (measured > predicted)
+    {
+        predicted = measured;
+    }
+
+    _dvfsWindowStart = _counterMs;
+    _dvfsBusyMs = 0;
+
+    // The run times were measured at the current speed, bring them to full speed
+    predicted = (predicted * _dvfsSpeed[_dvfsLevel]) / 1000;
+    _dvfsRequired = (predicted < 0xFFFF) ? (uint16_t) predicted : 0xFFFF;
+
+    // Lowest speed that keeps the utilization under the target
+    for (level = 0; level < (uKERNEL_DVFS_LEVELS - 1); level++)
+    {
+        if ((predicted * 1000) <= ((uint32_t) uKERNEL_DVFS_TARGET * _dvfsSpeed[level]))
+        {
+            break;
+        }
+    }
+
+    if (level != _dvfsLevel)
+    {
+        _dvfsLevel = level;
+        // The port keeps the tick at 1 ms at the new clock
+        uKERNEL_SET_FREQUENCY(level);
+    }
+}
+
+#endif
+
+#if uKERNEL_USE_GROUPS
+
+bool uKernelGroupInit(uKernelGroup *pGroup,
+                      uint16_t budget,
+                      uint16_t period,
+                      uKernelGroup *pParent)
+{
+    if ((pGroup == NULL) || (period == 0) || (budget > period)
+            || (pParent == pGroup))
+    {
+        return false;
+    }
+
+    pGroup->budget = budget;
+    pGroup->period = period;
+    pGroup->used = 0;
+    pGroup->periodStart = _counterMs;
+    pGroup->throttled = 0;
+    pGroup->pParent = pParent;
+
+    return true;
+}
+
+bool uKernelSetTaskGroup(uKernelTaskDescriptor *pTaskDescriptor,
+                         uKernelGroup *pGroup)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    pTaskDescriptor->pGroup = pGroup;
+
+    return true;
+}
+
+static bool uKernelGroupHasBudget(uKernelGroup *pGroup)
+{
+    uint32_t elapsed;
+
+    for (; pGroup != NULL; pGroup = pGroup->pParent)
+    {
+        elapsed = _counterMs - pGroup->periodStart;
+
+        // Replenish, staying on the period grid of the group
+        if (elapsed >= pGroup->period)
+        {
+            pGroup->periodStart += elapsed - (elapsed % pGroup->period);
+            pGroup->used = 0;
+        }
+
+        if (pGroup->used >= pGroup->budget)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void uKernelGroupCharge(uKernelGroup *pGroup, uint32_t duration)
+{
+    for (; pGroup != NULL; pGroup = pGroup->pParent)
+    {
+        if ((pGroup->used < pGroup->budget)
+                && ((pGroup->used + duration) >= pGroup->budget))
+        {
+            pGroup->throttled++;
+        }
+
+        pGroup->used = (duration > (uint32_t) (0xFFFF - pGroup->used)) ?
+                0xFFFF : pGroup->used + (uint16_t) duration;
+    }
+}
+
+#endif
+
+#if uKERNEL_USE_TASK_ID
+
+uint8_t uKernelGetTaskId(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    return (pTaskDescriptor != NULL) ? pTaskDescriptor->taskId : 0;
+}
+
+/**
+ * Give the lowest identifier not in use, so the tasks fill the watch block
+ * and the statistics first, and clear the figures left by its last task.
+ * @return The identifier, uKERNEL_NO_TASK_ID if all are in use.
+ */
+static uint8_t uKernelTaskIdAlloc(void)
+{
+    uint8_t i;
+    uint8_t bit;
+    uint8_t used;
+    uint8_t taskId = uKERNEL_NO_TASK_ID;
+#if uKERNEL_USE_CORE_STATS
+    uint8_t core;
+#endif
+
+    for (i = 0; (i < sizeof (_taskIdUsed)) && (taskId == uKERNEL_NO_TASK_ID); i++)
+    {
+#if uKERNEL_USE_MULTICORE
+        //the cores add their tasks at the same time
+        used = __atomic_load_n(&_taskIdUsed[i], __ATOMIC_RELAXED);
+#else
+        used = _taskIdUsed[i];
+#endif
+        for (bit = 0; (bit < 8) && (taskId == uKERNEL_NO_TASK_ID); bit++)
+        {
+            if ((used & (1 << bit)) || (((i << 3) | bit) == uKERNEL_NO_TASK_ID))
+            {
+                continue;
+            }
+#if uKERNEL_USE_MULTICORE
+            if (!__atomic_compare_exchange_n(&_taskIdUsed[i], &used,
+                                             (uint8_t) (used | (1 << bit)),
+                                             false, __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED))
+            {
+                //another core took one, look at the byte again
+                bit = (uint8_t) -1;
+                continue;
+            }
+#else
+            _taskIdUsed[i] = (uint8_t) (used | (1 << bit));
+#endif
+            taskId = (uint8_t) ((i << 3) | bit);
+        }
+    }
+
+#if uKERNEL_USE_WATCH
+    if (taskId < uKERNEL_WATCH_TASKS)
+    {
+        uKernelWatch.sequence++;
+        uKernelWatch.task[taskId].runCount = 0;
+        uKernelWatch.task[taskId].lastLateness = 0;
+        uKernelWatch.task[taskId].maxLateness = 0;
+        uKernelWatch.task[taskId].lastExecution = 0;
+        uKernelWatch.task[taskId].maxExecution = 0;
+        uKernelWatch.sequence++;
+    }
+#endif
+#if uKERNEL_USE_CORE_STATS
+    if (taskId < uKERNEL_STATS_TASKS)
+    {
+        for (core = 0; core < uKERNEL_CORES; core++)
+        {
+            _coreStats[core].task[taskId].runCount = 0;
+            _coreStats[core].task[taskId].busyMs = 0;
+            _coreStats[core].task[taskId].maxExecution = 0;
+        }
+    }
+#endif
+
+    return taskId;
+}
+
+static void uKernelTaskIdFree(uint8_t taskId)
+{
+    if (taskId == uKERNEL_NO_TASK_ID)
+    {
+        return;
+    }
+
+#if uKERNEL_USE_MULTICORE
+    __atomic_fetch_and(&_taskIdUsed[taskId >> 3],
+                       (uint8_t) ~(1 << (taskId & 0x07)), __ATOMIC_RELAXED);
+#else
+    _taskIdUsed[taskId >> 3] &= (uint8_t) ~(1 << (taskId & 0x07));
+#endif
+}
+
+#endif
+
+#if uKERNEL_USE_WATCH
+
+static void uKernelWatchInit(void)
+{
+    uint8_t i;
+
+    uKernelWatch.sequence++;
+
+    uKernelWatch.magic = uKERNEL_WATCH_MAGIC;
+    uKernelWatch.version = uKERNEL_WATCH_VERSION;
+    uKernelWatch.taskCount = uKERNEL_WATCH_TASKS;
+    uKernelWatch.size = sizeof (uKernelWatchBlock);
+    uKernelWatch.cpuLoadPermille = 0;
+    uKernelWatch.time = _counterMs;
+
+    for (i = 0; i < uKERNEL_WATCH_TASKS; i++)
+    {
+        uKernelWatch.task[i].runCount = 0;
+        uKernelWatch.task[i].lastLateness = 0;
+        uKernelWatch.task[i].maxLateness = 0;
+        uKernelWatch.task[i].lastExecution = 0;
+        uKernelWatch.task[i].maxExecution = 0;
+    }
+
+    _watchBusyMs = 0;
+    _watchWindowStart = _counterMs;
+
+    uKernelWatch.sequence++;
+}
+
+static void uKernelWatchUpdate(uint8_t taskId,
+                               uint32_t lateness,
+                               uint32_t duration)
+{
+    volatile uKernelWatchTask *pWatchTask;
+#if !uKERNEL_USE_OVERHEAD
+    uint32_t window;
+#endif
+
+    if (taskId >= uKERNEL_WATCH_TASKS)
+    {
+        return;
+    }
+
+    pWatchTask = &uKernelWatch.task[taskId];
+
+    //odd while the block is being written
+    uKernelWatch.sequence++;
+
+    pWatchTask->runCount++;
+    pWatchTask->lastLateness = (lateness < 0xFFFF) ? (uint16_t) lateness : 0xFFFF;
+    if (pWatchTask->lastLateness > pWatchTask->maxLateness)
+    {
+        pWatchTask->maxLateness = pWatchTask->lastLateness;
+    }
+    pWatchTask->lastExecution = (duration < 0xFFFF) ? (uint16_t) duration : 0xFFFF;
+    if (pWatchTask->lastExecution > pWatchTask->maxExecution)
+    {
+        pWatchTask->maxExecution = pWatchTask->lastExecution;
+    }
+    uKernelWatch.time = _counterMs;
+
+#if !uKERNEL_USE_OVERHEAD
+    // Without the cycle counter the load comes from the run times
+    _watchBusyMs += duration;
+
+    window = _counterMs - _watchWindowStart;
+    if (window >= uKERNEL_WATCH_WINDOW_MS)
+    {
+        uKernelWatch.cpuLoadPermille = (uint16_t) ((_watchBusyMs >= window) ?
+                1000 : (_watchBusyMs * 1000) / window);
+        _watchBusyMs = 0;
+        _watchWindowStart = _counterMs;
+    }
+#endif
+
+    uKernelWatch.sequence++;
+}
+
+#endif
+
+#if uKERNEL_USE_TRACE
+
+uint8_t uKernelGetPostMortem(uKernelDispatchRecord *pRecords,
+                             uint8_t maxRecords)
+{
+    uint8_t i;
+    uint8_t count = _postMortem.count;
+    uint8_t index;
+
+    if ((pRecords == NULL) || (_postMortem.magic != uKERNEL_POSTMORTEM_MAGIC))
+    {
+        return 0;
+    }
+
+    if (count > maxRecords)
+    {
+        count = maxRecords;
+    }
+
+    // Copy the newest records, the oldest of them first
+    index = (_postMortem.next + uKERNEL_POSTMORTEM_RECORDS - count)
+            % uKERNEL_POSTMORTEM_RECORDS;
+
+    for (i = 0; i < count; i++)
+    {
+        pRecords[i] = _postMortem.record[index];
+        index = (index + 1) % uKERNEL_POSTMORTEM_RECORDS;
+    }
+
+    return count;
+}
+
+#endif
+
+#if uKERNEL_USE_COROUTINES
+
+uKernelTaskDescriptor *uKernelGetCurrentTask(void)
+{
+    return pTaskRunning;
+}
+
+bool uKernelTaskSleep(uint32_t delay)
+{
+    if (pTaskRunning == NULL)
+    {
+        return false;
+    }
+
+    pTaskRunning->plannedTask = _counterMs + delay;
+
+    //a one time task has been paused by the scheduler, keep it for this release
+    if (pTaskRunning->taskStatus == uKernel_PAUSED)
+    {
+        pTaskRunning->taskStatus = uKernel_ONETIME;
+    }
+
+    return true;
+}
+
+#endif
+
+#if uKERNEL_USE_EVENTS
+
+bool uKernelReleaseTask(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    pTaskDescriptor->taskReleased = true;
+
+    return true;
+}
+
+#endif
+
+#if uKERNEL_USE_READY_BITMAP
+
+bool uKernelPostTask(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL)
+            || (pTaskDescriptor->readySlot == uKERNEL_READY_NONE)
+#if uKERNEL_USE_MULTICORE
+            //the bitmap belongs to the core, the post queue goes across cores
+            || (pTaskDescriptor->taskCore != _coreId)
+#endif
+            )
+    {
+        return false;
+    }
+
+    uKernelReadyPost((uint32_t) 1 << pTaskDescriptor->readySlot, false);
+
+    return true;
+}
+
+bool uKernelPostTaskFromISR(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL)
+            || (pTaskDescriptor->readySlot == uKERNEL_READY_NONE)
+#if uKERNEL_USE_MULTICORE
+            //the bitmap belongs to the core, the post queue goes across cores
+            || (pTaskDescriptor->taskCore != _coreId)
+#endif
+            )
+    {
+        return false;
+    }
+
+    uKernelReadyPost((uint32_t) 1 << pTaskDescriptor->readySlot, true);
+
+    return true;
+}
+
+static void uKernelReadyPost(uint32_t mask, bool fromISR)
+{
+#if defined(__ATOMIC_ACQ_REL)
+    // A single atomic OR, whatever the number of interrupt sources
+    (void) fromISR;
+
+    __atomic_fetch_or(&_readyBitmap, mask, __ATOMIC_RELEASE);
+#else
+    if (fromISR == false)
+    {
+        uKERNEL_DISABLE_INTERRUPTS();
+    }
+
+    _readyBitmap |= mask;
+
+    if (fromISR == false)
+    {
+        uKERNEL_ENABLE_INTERRUPTS();
+    }
+#endif
+}
+
+static void uKernelRunReady(void)
+{
+    uKernelTaskDescriptor *pTask;
+    uint32_t ready;
+    uint8_t slot;
+
+    // Take all the posts at once, the ones coming meanwhile wait for the
+    // next pass
+#if defined(__ATOMIC_ACQ_REL)
+    ready = __atomic_exchange_n(&_readyBitmap, 0, __ATOMIC_ACQUIRE);
+#else
+    uKERNEL_DISABLE_INTERRUPTS();
+    ready = _readyBitmap;
+    _readyBitmap = 0;
+    uKERNEL_ENABLE_INTERRUPTS();
+#endif
+
+    while (ready != 0)
+    {
+#if defined(__GNUC__)
+        slot = (uint8_t) __builtin_ctzl((unsigned long) ready);
+#else
+        for (slot = 0; (ready & ((uint32_t) 1 << slot)) == 0; slot++)
+        {
+        }
+#endif
+        ready &= ready - 1; //clear the lowest bit
+
+        pTask = pReadyTask[slot];
+        if (pTask == NULL)
+        {
+            continue;
+        }
+
+        if (uKERNEL_GROUP_ALLOWS(pTask))
+        {
+            uKernelDispatch(pTask);
+        }
+        else
+        {
+            //keep the post until the group has budget again
+            uKernelReadyPost((uint32_t) 1 << slot, false);
+        }
+    }
+}
+
+static void uKernelReadyReset(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < uKERNEL_READY_SLOTS; i++)
+    {
+        pReadyTask[i] = NULL;
+    }
+
+    _readyBitmap = 0;
+}
+
+static uint8_t uKernelReadyAlloc(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    uint8_t i;
+
+    for (i = 0; i < uKERNEL_READY_SLOTS; i++)
+    {
+        if (pReadyTask[i] == NULL)
+        {
+            pReadyTask[i] = pTaskDescriptor;
+
+            return i;
+        }
+    }
+
+    return uKERNEL_READY_NONE;
+}
+
+static void uKernelReadyFree(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    uint8_t slot = pTaskDescriptor->readySlot;
+
+    if (slot == uKERNEL_READY_NONE)
+    {
+        return;
+    }
+
+    pTaskDescriptor->readySlot = uKERNEL_READY_NONE;
+
+    // Drop a pending post, the slot may be given to another task
+#if defined(__ATOMIC_ACQ_REL)
+    __atomic_fetch_and(&_readyBitmap, ~((uint32_t) 1 << slot), __ATOMIC_RELEASE);
+#else
+    uKERNEL_DISABLE_INTERRUPTS();
+    _readyBitmap &= ~((uint32_t) 1 << slot);
+    uKERNEL_ENABLE_INTERRUPTS();
+#endif
+    pReadyTask[slot] = NULL;
+}
+
+#endif
+
+#if uKERNEL_USE_POST_QUEUE
+
+bool uKernelEnqueueTask(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    uKernelPushPost(pTaskDescriptor, false);
+
+    return true;
+}
+
+bool uKernelEnqueueTaskFromISR(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((_initialized == false) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    uKernelPushPost(pTaskDescriptor, true);
+
+    return true;
+}
+
+static void uKernelPushPost(uKernelTaskDescriptor *pTaskDescriptor,
+                            bool fromISR)
+{
+#if defined(__ATOMIC_ACQ_REL)
+    uKernelTaskDescriptor *pHead;
+
+    (void) fromISR;
+
+    // Already in the queue, the posts are merged
+    if (__atomic_exchange_n(&pTaskDescriptor->postState, uKERNEL_POST_QUEUED,
+                            __ATOMIC_ACQ_REL) != uKERNEL_POST_IDLE)
+    {
+        return;
+    }
+
+    // Lock-free push on the head, any number of producers
+    pHead = __atomic_load_n(&uKERNEL_POST_HEAD(pTaskDescriptor->taskCore),
+                            __ATOMIC_RELAXED);
+    do
+    {
+        pTaskDescriptor->pPostNext = pHead;
+    }
+    while (!__atomic_compare_exchange_n(&uKERNEL_POST_HEAD(pTaskDescriptor->taskCore),
+                                        &pHead, pTaskDescriptor,
+                                        true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+#else
+    if (fromISR == false)
+    {
+        uKERNEL_DISABLE_INTERRUPTS();
+    }
+
+    if (pTaskDescriptor->postState == uKERNEL_POST_IDLE)
+    {
+        pTaskDescriptor->pPostNext = uKERNEL_POST_HEAD(pTaskDescriptor->taskCore);
+        uKERNEL_POST_HEAD(pTaskDescriptor->taskCore) = pTaskDescriptor;
+    }
+    pTaskDescriptor->postState = uKERNEL_POST_QUEUED;
+
+    if (fromISR == false)
+    {
+        uKERNEL_ENABLE_INTERRUPTS();
+    }
+#endif
+}
+
+static void uKernelRunPosted(void)
+{
+    uKernelTaskDescriptor *pList;
+    uKernelTaskDescriptor *pFifo = NULL;
+    uKernelTaskDescriptor *pNext;
+    uint8_t state;
+
+    // Take the whole queue, the producers start a new one
+#if defined(__ATOMIC_ACQ_REL)
+    pList = __atomic_exchange_n(&uKERNEL_POST_HEAD(_coreId), NULL,
+                                __ATOMIC_ACQUIRE);
+#else
+    uKERNEL_DISABLE_INTERRUPTS();
+    pList = uKERNEL_POST_HEAD(_coreId);
+    uKERNEL_POST_HEAD(_coreId) = NULL;
+    uKERNEL_ENABLE_INTERRUPTS();
+#endif
+
+    // The pushes made a stack, turn it back to the posting order
+    while (pList != NULL)
+    {
+        pNext = pList->pPostNext;
+        pList->pPostNext = pFifo;
+        pFifo = pList;
+        pList = pNext;
+    }
+
+    while (pFifo != NULL)
+    {
+        pNext = pFifo->pPostNext;
+
+        // Clear the state first, a post made while it runs queues it again
+#if defined(__ATOMIC_ACQ_REL)
+        state = __atomic_exchange_n(&pFifo->postState, uKERNEL_POST_IDLE,
+                                    __ATOMIC_ACQ_REL);
+#else
+        uKERNEL_DISABLE_INTERRUPTS();
+        state = pFifo->postState;
+        pFifo->postState = uKERNEL_POST_IDLE;
+        uKERNEL_ENABLE_INTERRUPTS();
+#endif
+
+#if uKERNEL_USE_MULTICORE
+        if ((state == uKERNEL_POST_QUEUED) && (pFifo->taskCore != _coreId))
+        {
+            //posted just before it moved, its new core will run it
+            uKernelPushPost(pFifo, false);
+        }
+        else
+#endif
+        if (state == uKERNEL_POST_QUEUED)
+        {
+            if (uKERNEL_GROUP_ALLOWS(pFifo))
+            {
+                uKernelDispatch(pFifo);
+            }
+            else
+            {
+                //keep the post until the group has budget again
+                uKernelPushPost(pFifo, false);
+            }
+        }
+
+        pFifo = pNext;
+    }
+}
+
+static void uKernelCancelPost(uKernelTaskDescriptor *pTaskDescriptor)
+{
+    // It can't be unlinked from the queue, the drain will skip it, so the
+    // descriptor has to live until the next pass of its core
+#if defined(__ATOMIC_ACQ_REL)
+    uint8_t queued = uKERNEL_POST_QUEUED;
+
+    __atomic_compare_exchange_n(&pTaskDescriptor->postState, &queued,
+                                uKERNEL_POST_CANCELLED, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#else
+    uKERNEL_DISABLE_INTERRUPTS();
+    if (pTaskDescriptor->postState == uKERNEL_POST_QUEUED)
+    {
+        pTaskDescriptor->postState = uKERNEL_POST_CANCELLED;
+    }
+    uKERNEL_ENABLE_INTERRUPTS();
+#endif
+}
+
+#endif
+
+#if uKERNEL_USE_PINGPONG
+
+void *uKernelPingPongInit(uKernelPingPong *pPingPong,
+                          void * const *pBuffers,
+                          uint8_t bufferCount,
+                          uKernelTaskDescriptor *pConsumerTask)
+{
+    uint8_t i;
+
+    if ((pPingPong == NULL) || (pBuffers == NULL)
+            || (bufferCount < 2) || (bufferCount > 3))
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < bufferCount; i++)
+    {
+        pPingPong->pBuffer[i] = pBuffers[i];
+    }
+
+    pPingPong->bufferCount = bufferCount;
+    pPingPong->fillIndex = 0;
+    pPingPong->readyIndex = uKERNEL_NO_BUFFER;
+    pPingPong->busyIndex = uKERNEL_NO_BUFFER;
+    pPingPong->overruns = 0;
+    pPingPong->pConsumerTask = pConsumerTask;
+
+    return pPingPong->pBuffer[0];
+}
+
+void *uKernelPingPongFilledFromISR(uKernelPingPong *pPingPong)
+{
+    uint8_t i;
+
+    // Look for a buffer that the consumer doesn't own, an unread ready buffer
+    // is older than the one just filled so it can be reused
+    for (i = 0; i < pPingPong->bufferCount; i++)
+    {
+        if ((i != pPingPong->fillIndex) && (i != pPingPong->busyIndex))
+        {
+            break;
+        }
+    }
+
+    if (i == pPingPong->bufferCount)
+    {
+        // Double buffering and the consumer still holds the other buffer
+        pPingPong->overruns++;
+
+        return pPingPong->pBuffer[pPingPong->fillIndex];
+    }
+
+    if (pPingPong->readyIndex != uKERNEL_NO_BUFFER)
+    {
+        pPingPong->overruns++;
+    }
+
+    pPingPong->readyIndex = pPingPong->fillIndex;
+    pPingPong->fillIndex = i;
+
+    if (pPingPong->pConsumerTask != NULL)
+    {
+        pPingPong->pConsumerTask->taskReleased = true;
+    }
+
+    return pPingPong->pBuffer[i];
+}
+
+void *uKernelPingPongAcquire(uKernelPingPong *pPingPong)
+{
+    void *pBuffer = NULL;
+
+    uKERNEL_DISABLE_INTERRUPTS();
+
+    if (pPingPong->readyIndex != uKERNEL_NO_BUFFER)
+    {
+        pPingPong->busyIndex = pPingPong->readyIndex;
+        pPingPong->readyIndex = uKERNEL_NO_BUFFER;
+        pBuffer = pPingPong->pBuffer[pPingPong->busyIndex];
+    }
+
+    uKERNEL_ENABLE_INTERRUPTS();
+
+    return pBuffer;
+}
+
+void uKernelPingPongRelease(uKernelPingPong *pPingPong)
+{
+    pPingPong->busyIndex = uKERNEL_NO_BUFFER;
+}
+
+#endif
+
+#if uKERNEL_USE_LATEST
+
+void *uKernelLatestInit(uKernelLatest *pLatest, void * const *pBuffers)
+{
+    if ((pLatest == NULL) || (pBuffers == NULL))
+    {
+        return NULL;
+    }
+
+    pLatest->pBuffer[0] = pBuffers[0];
+    pLatest->pBuffer[1] = pBuffers[1];
+    pLatest->pBuffer[2] = pBuffers[2];
+    pLatest->writeIndex = 0;
+    pLatest->middleIndex = 1;
+    pLatest->readIndex = 2;
+    pLatest->hasValue = false;
+
+    return pLatest->pBuffer[0];
+}
+
+void *uKernelLatestPublish(uKernelLatest *pLatest)
+{
+    pLatest->writeIndex = uKernelLatestExchange(pLatest,
+            pLatest->writeIndex | uKERNEL_LATEST_NEW, false) & uKERNEL_LATEST_INDEX;
+
+    return pLatest->pBuffer[pLatest->writeIndex];
+}
+
+void *uKernelLatestPublishFromISR(uKernelLatest *pLatest)
+{
+    pLatest->writeIndex = uKernelLatestExchange(pLatest,
+            pLatest->writeIndex | uKERNEL_LATEST_NEW, true) & uKERNEL_LATEST_INDEX;
+
+    return pLatest->pBuffer[pLatest->writeIndex];
+}
+
+const void *uKernelLatestRead(uKernelLatest *pLatest)
+{
+    // Only exchange when the writer left a new value, otherwise keep ours
+    if (pLatest->middleIndex & uKERNEL_LATEST_NEW)
+    {
+        pLatest->readIndex = uKernelLatestExchange(pLatest,
+                pLatest->readIndex, false) & uKERNEL_LATEST_INDEX;
+        pLatest->hasValue = true;
+    }
+
+    return (pLatest->hasValue ? pLatest->pBuffer[pLatest->readIndex] : NULL);
+}
+
+const void *uKernelLatestReadFromISR(uKernelLatest *pLatest)
+{
+    if (pLatest->middleIndex & uKERNEL_LATEST_NEW)
+    {
+        pLatest->readIndex = uKernelLatestExchange(pLatest,
+                pLatest->readIndex, true) & uKERNEL_LATEST_INDEX;
+        pLatest->hasValue = true;
+    }
+
+    return (pLatest->hasValue ? pLatest->pBuffer[pLatest->readIndex] : NULL);
+}
+
+#endif
+
+#if uKERNEL_USE_PUBSUB
+
+bool uKernelFramePoolInit(uKernelFramePool *pPool,
+                          uKernelFrame *pFrames,
+                          void *pStorage,
+                          uint16_t frameSize,
+                          uint8_t frameCount)
+{
+    uint8_t i;
+
+    if ((pPool == NULL) || (pFrames == NULL) || (pStorage == NULL)
+            || (frameSize == 0))
+    {
+        return false;
+    }
+
+    pPool->pFirstFree = NULL;
+
+    // Chain the frames backwards so the first one is given first
+    for (i = frameCount; i > 0; i--)
+    {
+        pFrames[i - 1].pData = (uint8_t *) pStorage + (i - 1) * frameSize;
+        pFrames[i - 1].refCount = 0;
+        pFrames[i - 1].pPool = pPool;
+        pFrames[i - 1].pNextFree = pPool->pFirstFree;
+        pPool->pFirstFree = &pFrames[i - 1];
+    }
+
+    return true;
+}
+
+uKernelFrame *uKernelFrameAlloc(uKernelFramePool *pPool)
+{
+    uKernelFrame *pFrame;
+
+    if ((pPool == NULL) || (pPool->pFirstFree == NULL))
+    {
+        return NULL;
+    }
+
+    pFrame = pPool->pFirstFree;
+    pPool->pFirstFree = pFrame->pNextFree;
+    pFrame->pNextFree = NULL;
+    pFrame->refCount = 1;
+
+    return pFrame;
+}
+
+void uKernelFrameRelease(uKernelFrame *pFrame)
+{
+    if ((pFrame == NULL) || (pFrame->refCount == 0))
+    {
+        return;
+    }
+
+    if (--pFrame->refCount == 0)
+    {
+        pFrame->pNextFree = pFrame->pPool->pFirstFree;
+        pFrame->pPool->pFirstFree = pFrame;
+    }
+}
+
+bool uKernelSubscribe(uKernelTopic *pTopic,
+                      uKernelSubscriber *pSubscriber,
+                      uKernelTaskDescriptor *pTaskDescriptor)
+{
+    if ((pTopic == NULL) || (pSubscriber == NULL) || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    pSubscriber->pTask = pTaskDescriptor;
+    pSubscriber->pFrame = NULL;
+    pSubscriber->dropped = 0;
+    pSubscriber->pNext = pTopic->pFirst;
+    pTopic->pFirst = pSubscriber;
+
+    return true;
+}
+
+bool uKernelUnsubscribe(uKernelTopic *pTopic, uKernelSubscriber *pSubscriber)
+{
+    uKernelSubscriber **ppWork;
+
+    if ((pTopic == NULL) || (pSubscriber == NULL))
+    {
+        return false;
+    }
+
+    for (ppWork = &pTopic->pFirst; *ppWork != NULL; ppWork = &(*ppWork)->pNext)
+    {
+        if (*ppWork == pSubscriber)
+        {
+            *ppWork = pSubscriber->pNext;
+            uKernelFrameRelease(pSubscriber->pFrame);
+            pSubscriber->pFrame = NULL;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t uKernelPublish(uKernelTopic *pTopic, uKernelFrame *pFrame)
+{
+    uKernelSubscriber *pWork;
+    uint8_t count = 0;
+
+    if ((pTopic == NULL) || (pFrame == NULL))
+    {
+        return 0;
+    }
+
+    for (pWork = pTopic->pFirst; pWork != NULL; pWork = pWork->pNext)
+    {
+        // A frame the task didn't take yet is replaced by the newer one
+        if (pWork->pFrame != NULL)
+        {
+            uKernelFrameRelease(pWork->pFrame);
+            pWork->dropped++;
+        }
+
+        pFrame->refCount++;
+        pWork->pFrame = pFrame;
+        pWork->pTask->taskReleased = true;
+        count++;
+    }
+
+    // Hand over the reference of the publisher
+    uKernelFrameRelease(pFrame);
+
+    return count;
+}
+
+uKernelFrame *uKernelTake(uKernelSubscriber *pSubscriber)
+{
+    uKernelFrame *pFrame;
+
+    if (pSubscriber == NULL)
+    {
+        return NULL;
+    }
+
+    pFrame = pSubscriber->pFrame;
+    pSubscriber->pFrame = NULL;
+
+    return pFrame;
+}
+
+#endif
+
+#if uKERNEL_USE_DEADLINE_QUEUE
+
+bool uKernelDeadlineQueueInit(uKernelDeadlineQueue *pQueue,
+                              uKernelDeadlineMessage *pStorage,
+                              uint8_t capacity,
+                              uint32_t leadTime,
+                              uKernelTaskDescriptor *pConsumerTask)
+{
+    if ((pQueue == NULL) || (pStorage == NULL) || (capacity == 0))
+    {
+        return false;
+    }
+
+    pQueue->pHeap = pStorage;
+    pQueue->capacity = capacity;
+    pQueue->count = 0;
+    pQueue->leadTime = leadTime;
+    pQueue->dropped = 0;
+    pQueue->pConsumerTask = pConsumerTask;
+
+    return true;
+}
+
+bool uKernelDeadlineQueueSend(uKernelDeadlineQueue *pQueue,
+                              void *pMessage,
+                              uint32_t deadline)
+{
+    bool sent;
+
+    uKERNEL_DISABLE_INTERRUPTS();
+    sent = uKernelDeadlineInsert(pQueue, pMessage, deadline);
+    if (sent)
+    {
+        // Only an earlier deadline can bring the consumer forward
+        uKernelDeadlineRetarget(pQueue, false);
+    }
+    uKERNEL_ENABLE_INTERRUPTS();
+
+    return sent;
+}
+
+bool uKernelDeadlineQueueSendFromISR(uKernelDeadlineQueue *pQueue,
+                                     void *pMessage,
+                                     uint32_t deadline)
+{
+    if (!uKernelDeadlineInsert(pQueue, pMessage, deadline))
+    {
+        return false;
+    }
+
+    // The planned time can't be written safely from here, the consumer is
+    // released and plans itself when it calls uKernelDeadlineQueueReceive
+    if (pQueue->pConsumerTask != NULL)
+    {
+        pQueue->pConsumerTask->taskReleased = true;
+    }
+
+    return true;
+}
+
+void *uKernelDeadlineQueueReceive(uKernelDeadlineQueue *pQueue,
+                                  uint32_t *pDeadline)
+{
+    void *pMessage = NULL;
+
+    if ((pQueue == NULL) || (pQueue->count == 0))
+    {
+        return NULL;
+    }
+
+    uKERNEL_DISABLE_INTERRUPTS();
+
+    if ((int32_t) (_counterMs - (pQueue->pHeap[0].deadline - pQueue->leadTime)) >= 0)
+    {
+        pMessage = pQueue->pHeap[0].pMessage;
+        if (pDeadline != NULL)
+        {
+            *pDeadline = pQueue->pHeap[0].deadline;
+        }
+
+        pQueue->count--;
+        if (pQueue->count != 0)
+        {
+            pQueue->pHeap[0] = pQueue->pHeap[pQueue->count];
+            uKernelDeadlineSiftDown(pQueue, 0);
+        }
+    }
+
+    // The consumer follows the earliest deadline left
+    if (pQueue->count != 0)
+    {
+        uKernelDeadlineRetarget(pQueue, true);
+    }
+
+    uKERNEL_ENABLE_INTERRUPTS();
+
+    return pMessage;
+}
+
+static bool uKernelDeadlineInsert(uKernelDeadlineQueue *pQueue,
+                                  void *pMessage,
+                                  uint32_t deadline)
+{
+    if (pQueue == NULL)
+    {
+        return false;
+    }
+
+    if (pQueue->count == pQueue->capacity)
+    {
+        pQueue->dropped++;
+
+        return false;
+    }
+
+    pQueue->pHeap[pQueue->count].pMessage = pMessage;
+    pQueue->pHeap[pQueue->count].deadline = deadline;
+    pQueue->count++;
+    uKernelDeadlineSiftUp(pQueue, pQueue->count - 1);
+
+    return true;
+}
+
+static void uKernelDeadlineRetarget(uKernelDeadlineQueue *pQueue, bool always)
+{
+    uKernelTaskDescriptor *pTask = pQueue->pConsumerTask;
+    uint32_t release;
+
+    if (pTask == NULL)
+    {
+        return;
+    }
+
+    release = pQueue->pHeap[0].deadline - pQueue->leadTime;
+
+    // The consumer is run once at the release of the most urgent message
+    if (always || (pTask->taskStatus == uKernel_PAUSED)
+            || ((int32_t) (release - pTask->plannedTask) < 0))
+    {
+        pTask->plannedTask = release;
+        pTask->taskStatus = uKernel_ONETIME;
+    }
+}
+
+static void uKernelDeadlineSiftUp(uKernelDeadlineQueue *pQueue, uint8_t index)
+{
+    uKernelDeadlineMessage message = pQueue->pHeap[index];
+    uint8_t parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1) >> 1;
+
+        //compare the difference so the deadlines can overflow
+        if ((int32_t) (message.deadline - pQueue->pHeap[parent].deadline) >= 0)
+        {
+            break;
+        }
+
+        pQueue->pHeap[index] = pQueue->pHeap[parent];
+        index = parent;
+    }
+
+    pQueue->pHeap[index] = message;
+}
+
+static void uKernelDeadlineSiftDown(uKernelDeadlineQueue *pQueue, uint8_t index)
+{
+    uKernelDeadlineMessage message = pQueue->pHeap[index];
+    uint8_t child;
+
+    while ((child = (index << 1) + 1) < pQueue->count)
+    {
+        if (((child + 1) < pQueue->count)
+                && ((int32_t) (pQueue->pHeap[child + 1].deadline
+                               - pQueue->pHeap[child].deadline) < 0))
+        {
+            child++;
+        }
+
+        if ((int32_t) (pQueue->pHeap[child].deadline - message.deadline) >= 0)
+        {
+            break;
+        }
+
+        pQueue->pHeap[index] = pQueue->pHeap[child];
+        index = child;
+    }
+
+    pQueue->pHeap[index] = message;
+}
+
+#endif
+
+#if uKERNEL_USE_LATEST
+
+static uint8_t uKernelLatestExchange(uKernelLatest *pLatest,
+                                     uint8_t index,
+                                     bool fromISR)
+{
+#if defined(__ATOMIC_ACQ_REL)
+    // Compilers with atomics make it safe between cores too
+    (void) fromISR;
+
+    return __atomic_exchange_n(&pLatest->middleIndex, index, __ATOMIC_ACQ_REL);
+#else
+    uint8_t previous;
+
+    if (fromISR == false)
+    {
+        uKERNEL_DISABLE_INTERRUPTS();
+    }
+
+    previous = pLatest->middleIndex;
+    pLatest->middleIndex = index;
+
+    if (fromISR == false)
+    {
+        uKERNEL_ENABLE_INTERRUPTS();
+    }
+
+    return previous;
+#endif
+}
+
+#endif
+
+void uKernelDelayMiliseconds(uint16_t delay)
+{
+    uint32_t newTime = _counterMs + delay;
+    while (_counterMs < newTime);
+}
+
+uint8_t uKernelSetTask(uKernelTaskDescriptor *pTaskDescriptor,
+                       uint32_t taskInterval,
+                       uKernelTaskStatus tStatus)
+{
+    if ((_initialized == false) || (_numberTasks == MAX_TASKS_NUMBER)
+            || (pTaskDescriptor == NULL))
+    {
+        return false;
+    }
+
+    //as when adding, the IMMEDIATESTART bit only sets the first release
+    pTaskDescriptor->taskStatus = tStatus & 0x03;
+
+    if (tStatus & 0x04)
+    {
+        pTaskDescriptor->plannedTask = _counterMs;
+    }
+    else if (tStatus == uKernel_SCHEDULED)
     {
         if (taskInterval == NULL)
         {
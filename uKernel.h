@@ -28,10 +28,12 @@ extern "C"
 #include <stdbool.h>
 #include <stdint.h>
 
-#define MAX_TASKS_NUMBER            255
+#include "uKernelConfig.h"
 
-/**Set your max interval here (max 2^32-1) - default 3600000 (1 hour)*/
-#define MAX_TASK_INTERVAL           3600000UL
+#if uKERNEL_USE_PINGPONG
+/**Index used when a ping-pong buffer slot is not owned by anyone.*/
+#define uKERNEL_NO_BUFFER           0xFF
+#endif
 
 typedef enum
 {
@@ -49,9 +51,36 @@ typedef enum
     uKernel_ERROR = 0xFF //0b11111111
 } uKernelTaskStatus;
 
+/**Used to store a number of cycles of the port cycle counter.*/
+typedef uKERNEL_CYCLE_TYPE uKernelCycles;
+
 /**Function pointer on the task body.*/
 typedef void (*TaskBody)(void);
 
+#if uKERNEL_USE_GROUPS
+/**
+ * Reservation group. Tasks of a group together get at most budget
+ * milliseconds of execution every period milliseconds, once the budget is
+ * used they are held until the next period. A group can be nested in a parent
+ * group, its tasks then also need budget left in every parent.
+ */
+typedef struct _uKernelGroup
+{
+    /**Used to store the execution time granted each period*/
+    uint16_t budget;
+    /**Used to store the replenishment period*/
+    uint16_t period;
+    /**Used to store the execution time used in the current period*/
+    uint16_t used;
+    /**Used to store the start of the current period*/
+    uint32_t periodStart;
+    /**Used to count the periods in which the group was throttled*/
+    uint16_t throttled;
+    /**Pointer to the parent group, NULL for a top level group.*/
+    struct _uKernelGroup *pParent;
+} uKernelGroup;
+#endif
+
 typedef struct _uKernelTaskDescriptor
 {
     //    /**Pointer to the previous task in the list.*/
@@ -64,16 +93,404 @@ typedef struct _uKernelTaskDescriptor
     uint32_t plannedTask;
     /**Used to store the status of the tasks*/
     uKernelTaskStatus taskStatus;
+#if uKERNEL_USE_EVENTS
+    /**Set by uKernelReleaseTask to run the task on the next scheduler pass*/
+    volatile uint8_t taskReleased;
+#endif
+#if uKERNEL_USE_BUDGET
+    /**Used to store the maximum execution time of the task body, 0 for none*/
+    uint16_t executionBudget;
+    /**Used to count the runs that went over the execution budget*/
+    uint16_t budgetViolations;
+    /**Used to count the consecutive runs over budget, bit 7 enables demotion*/
+    uint8_t budgetStrikes;
+#endif
+#if uKERNEL_USE_PHASE
+    /**Used to store the last release done on the task's grid, or the first*/
+    uint32_t phaseAnchor;
+#endif
+#if uKERNEL_USE_TASK_ID
+    /**Used to store the identifier of the task, given when it is added*/
+    uint8_t taskId;
+#endif
+#if uKERNEL_USE_READY_BITMAP
+    /**Used to store the bit of the task in the ready bitmap, 0xFF for none*/
+    uint8_t readySlot;
+#endif
+#if uKERNEL_USE_POST_QUEUE
+    /**Pointer to the next task in the post queue*/
+    struct _uKernelTaskDescriptor *pPostNext;
+    /**Used to store whether the task is in the post queue*/
+    volatile uint8_t postState;
+#endif
+#if uKERNEL_USE_MULTICORE
+    /**Used to store the core running the task*/
+    volatile uint8_t taskCore;
+    /**Set to keep the task on its core*/
+    uint8_t taskPinned;
+#endif
+#if uKERNEL_USE_EXEC_AVERAGE
+    /**Used to store the average execution time, in 1/128 ms up to 511 ms*/
+    uint16_t executionAverage;
+#endif
+#if uKERNEL_USE_ENERGY
+    /**Used to store the time spent running the task*/
+    uint32_t activeMs;
+#endif
+#if uKERNEL_USE_GROUPS
+    /**Reservation group of the task, NULL if it doesn't belong to any*/
+    uKernelGroup *pGroup;
+#endif
     /**Pointer to the next task in the list.*/
     struct _uKernelTaskDescriptor *pTaskNext;
 } uKernelTaskDescriptor;
 
+#if uKERNEL_USE_BACKGROUND
+/**
+ * Background task, always ready. Background tasks run when a whole pass over
+ * the scheduled tasks found nothing to do, the one with the lowest pass value
+ * first, so each one gets a share of that time proportional to its weight.
+ */
+typedef struct
+{
+    /**Used to store the pointer to the user's task*/
+    TaskBody taskPointer;
+    /**Used to store the pass value advanced by the stride on each run*/
+    uint32_t pass;
+    /**Used to store the stride, uKERNEL_STRIDE_ONE over the weight*/
+    uint16_t stride;
+    /**Position of the task in the scheduler heap*/
+    uint8_t heapIndex;
+} uKernelBackgroundTask;
+#endif
+
+#if uKERNEL_USE_JOBS
+struct _uKernelJob;
+
+/**
+ * Function pointer on a job step. It does a small piece of the work, keeping
+ * where it is in the job state, and updates the progress of the job.
+ * @return True once the whole job is done.
+ */
+typedef bool (*JobStep)(struct _uKernelJob *pJob);
+
+/**
+ * Long job split in resumable steps. The scheduler runs the steps in the idle
+ * time, as many as fit before the next planned release, so the job never
+ * delays the tasks.
+ */
+typedef struct _uKernelJob
+{
+    /**Used to store the pointer to the user's step function*/
+    JobStep stepPointer;
+    /**Used to store the pointer to the user's job state*/
+    void *pState;
+    /**Used to store the progress of the job, from 0 to 100, set by the steps*/
+    volatile uint8_t progress;
+    /**Set by the scheduler once the job is done*/
+    volatile uint8_t done;
+    /**Task released when the job is done, can be NULL*/
+    uKernelTaskDescriptor *pNotifyTask;
+    /**Pointer to the next job waiting.*/
+    struct _uKernelJob *pNext;
+} uKernelJob;
+#endif
+
+#if uKERNEL_USE_PINGPONG
+/**
+ * Double or triple buffer exchanged between an ISR/DMA producer and a consumer
+ * task. Only the ownership of the buffers moves, the data is never copied.
+ */
+typedef struct
+{
+    /**Used to store the pointers to the user's buffers*/
+    void *pBuffer[3];
+    /**Used to store the number of buffers, 2 or 3*/
+    uint8_t bufferCount;
+    /**Buffer being filled by the producer*/
+    volatile uint8_t fillIndex;
+    /**Buffer filled and waiting for the consumer*/
+    volatile uint8_t readyIndex;
+    /**Buffer being processed by the consumer*/
+    volatile uint8_t busyIndex;
+    /**Used to count the filled buffers dropped because the consumer was late*/
+    volatile uint16_t overruns;
+    /**Task released each time a buffer is filled*/
+    uKernelTaskDescriptor *pConsumerTask;
+} uKernelPingPong;
+#endif
+
+#if uKERNEL_USE_LATEST
+/**
+ * Triple buffer holding the latest value of a state shared between a writer
+ * and a reader (tasks, interrupts or cores). Publishing and reading only
+ * exchange a buffer index, so the reader never blocks the writer and never
+ * sees a value being written.
+ */
+typedef struct
+{
+    /**Used to store the pointers to the user's buffers*/
+    void *pBuffer[3];
+    /**Buffer owned by the writer*/
+    uint8_t writeIndex;
+    /**Buffer owned by the reader*/
+    uint8_t readIndex;
+    /**Buffer exchanged between them, bit 7 is set when it holds a new value*/
+    volatile uint8_t middleIndex;
+    /**Set once the reader got a value*/
+    uint8_t hasValue;
+} uKernelLatest;
+#endif
+
+#if uKERNEL_USE_PUBSUB
+/**
+ * Buffer taken from a frame pool and shared by reference between a publisher
+ * and the subscribers of a topic. It goes back to its pool when the last
+ * reference is released.
+ */
+typedef struct _uKernelFrame
+{
+    /**Used to store the pointer to the frame data*/
+    void *pData;
+    /**Used to store the number of references held on the frame*/
+    uint8_t refCount;
+    /**Pool the frame belongs to*/
+    struct _uKernelFramePool *pPool;
+    /**Pointer to the next free frame in the pool.*/
+    struct _uKernelFrame *pNextFree;
+} uKernelFrame;
+
+/**Fixed number of frames of the same size, no heap involved.*/
+typedef struct _uKernelFramePool
+{
+    /**Pointer to the first free frame.*/
+    uKernelFrame *pFirstFree;
+} uKernelFramePool;
+
+/**Subscription of a task to a topic.*/
+typedef struct _uKernelSubscriber
+{
+    /**Task released when a frame is published*/
+    uKernelTaskDescriptor *pTask;
+    /**Frame published and not taken yet by the task*/
+    uKernelFrame *pFrame;
+    /**Used to count the frames replaced before the task took them*/
+    uint16_t dropped;
+    /**Pointer to the next subscriber of the topic.*/
+    struct _uKernelSubscriber *pNext;
+} uKernelSubscriber;
+
+/**Topic to which frames are published.*/
+typedef struct
+{
+    /**Pointer to the first subscriber of the topic.*/
+    uKernelSubscriber *pFirst;
+} uKernelTopic;
+#endif
+
+#if uKERNEL_USE_DEADLINE_QUEUE
+/**Message waiting in a deadline queue.*/
+typedef struct
+{
+    /**Used to store the pointer to the user's message*/
+    void *pMessage;
+    /**Used to store the time by which the message has to be handled*/
+    uint32_t deadline;
+} uKernelDeadlineMessage;
+
+/**
+ * Message queue ordered by deadline (a heap in the user's storage), the most
+ * urgent message comes out first whatever the order they were sent in. The
+ * consumer task is released at the earliest deadline minus the lead time.
+ */
+typedef struct
+{
+    /**Used to store the messages, the earliest deadline first*/
+    uKernelDeadlineMessage *pHeap;
+    /**Used to store the number of messages the storage can hold*/
+    uint8_t capacity;
+    /**Used to store the number of messages waiting*/
+    volatile uint8_t count;
+    /**Used to store how long before its deadline a message is handled*/
+    uint32_t leadTime;
+    /**Used to count the messages lost because the queue was full*/
+    uint16_t dropped;
+    /**Task run to handle the messages, can be NULL*/
+    uKernelTaskDescriptor *pConsumerTask;
+} uKernelDeadlineQueue;
+#endif
+
+#if uKERNEL_USE_COROUTINES
+/**Used to store the resume point of a coroutine task.*/
+typedef uint16_t uKernelCoroutine;
+
+/**
+ * Coroutine tasks. A task body written between uKERNEL_CO_BEGIN and
+ * uKERNEL_CO_END can suspend itself back into the scheduler and continue from
+ * the same point when it is released again, so a sequence can be written
+ * linearly. The state is a static uKernelCoroutine declared in the task body,
+ * there is no stack and no heap involved, so local variables are not kept
+ * between suspensions (use static ones). Do not use switch statements inside.
+ * Coroutine tasks are added as uKernel_SCHEDULED, their interval is the
+ * polling period used while they wait on a condition.
+ */
+#define uKERNEL_CO_BEGIN(co)        switch (co) { case 0:
+/**Suspend the task and resume it here after delay milliseconds.*/
+#define uKERNEL_CO_SLEEP(co, delay) \
+    do { (co) = __LINE__; uKernelTaskSleep(delay); return; \
+         case __LINE__:; } while (0)
+/**Suspend the task until its next release and resume it here.*/
+#define uKERNEL_CO_YIELD(co) \
+    do { (co) = __LINE__; return; case __LINE__:; } while (0)
+/**Suspend the task, on each release check cond and resume once it is true.*/
+#define uKERNEL_CO_WAIT_UNTIL(co, cond) \
+    do { (co) = __LINE__; case __LINE__: if (!(cond)) return; } while (0)
+/**End of the coroutine, the next release starts again from the beginning.*/
+#define uKERNEL_CO_END(co)          } (co) = 0
+#endif
+
+#if uKERNEL_USE_TRACE
+/**One dispatch of the post-mortem ring.*/
+typedef struct
+{
+    /**Used to store the time the task body was called*/
+    uint32_t startTime;
+    /**Used to store the run time, 0xFFFF if the body never returned*/
+    uint16_t duration;
+    /**Used to store the identifier of the task*/
+    uint8_t taskId;
+} uKernelDispatchRecord;
+#endif
+
+#if uKERNEL_USE_LOOKAHEAD
+/**One of the next releases.*/
+typedef struct
+{
+    /**Used to store the planned time of the release*/
+    uint32_t releaseTime;
+    /**Task to be released*/
+    uKernelTaskDescriptor *pTask;
+} uKernelRelease;
+#endif
+
+#if uKERNEL_USE_CALIBRATION
+/**Cost of the kernel operations measured on the actual part and clock.*/
+typedef struct
+{
+    /**Used to store the cost of a scheduler pass over a task not due*/
+    uKernelCycles schedulerPass;
+    /**Used to store the extra cost of a pass that dispatches a task*/
+    uKernelCycles dispatch;
+    /**Used to store the cost of adding and removing a task*/
+    uKernelCycles addRemove;
+} uKernelOverhead;
+#endif
+
+#if uKERNEL_USE_OVERHEAD
+/**Share of the CPU time over the last window, in per-mille.*/
+typedef struct
+{
+    /**Used to store the share of the scheduler bookkeeping around the tasks*/
+    uint16_t kernelPermille;
+    /**Used to store the share of the task bodies, jobs and background tasks*/
+    uint16_t taskPermille;
+    /**Used to store the share of spin and sleep with nothing to run*/
+    uint16_t idlePermille;
+} uKernelCpuLoad;
+#endif
+
+#if uKERNEL_USE_WATCH
+/**Value of the magic field of the statistics block, "uK".*/
+#define uKERNEL_WATCH_MAGIC         0x754B
+/**Version of the layout of the statistics block.*/
+#define uKERNEL_WATCH_VERSION       1
+
+/**Statistics of one task in the statistics block, times in milliseconds.*/
+typedef struct
+{
+    /**Used to count the runs of the task*/
+    uint32_t runCount;
+    /**Used to store the time between the release and the start of last run*/
+    uint16_t lastLateness;
+    /**Used to store the longest time between a release and a start*/
+    uint16_t maxLateness;
+    /**Used to store the execution time of the last run*/
+    uint16_t lastExecution;
+    /**Used to store the longest execution time*/
+    uint16_t maxExecution;
+} uKernelWatchTask;
+
+/**
+ * Statistics block read by the debuggers while the target runs. The layout
+ * only changes with the version. The sequence is odd while the scheduler
+ * updates the block, a tool reads it, then the block, then the sequence again
+ * and keeps the block if both sequences are the same and even.
+ */
+typedef struct
+{
+    /**Used to store uKERNEL_WATCH_MAGIC*/
+    uint16_t magic;
+    /**Used to store uKERNEL_WATCH_VERSION*/
+    uint8_t version;
+    /**Used to store the number of task entries, uKERNEL_WATCH_TASKS*/
+    uint8_t taskCount;
+    /**Used to store the size of the block in bytes*/
+    uint16_t size;
+    /**Used to store the CPU load in per-mille*/
+    uint16_t cpuLoadPermille;
+    /**Used to count the updates of the block, twice per update*/
+    volatile uint32_t sequence;
+    /**Used to store the time of the last update*/
+    uint32_t time;
+    /**Statistics of the tasks, indexed by their identifier*/
+    uKernelWatchTask task[uKERNEL_WATCH_TASKS];
+} uKernelWatchBlock;
+
+/**The statistics block, the symbol the tools look for.*/
+extern volatile uKernelWatchBlock uKernelWatch;
+#endif
+
+#if uKERNEL_USE_CORE_STATS
+/**
+ * Run statistics of a task. Each core keeps its own copy, on its own cache
+ * lines, they are added up when read.
+ */
+typedef struct
+{
+    /**Used to count the runs of the task*/
+    uint32_t runCount;
+    /**Used to store the total time spent in the task*/
+    uint32_t busyMs;
+    /**Used to store the longest run of the task*/
+    uint32_t maxExecution;
+} uKernelTaskStats;
+#endif
+
+#if uKERNEL_USE_ENERGY
+/**Energy used since uKernelInit or uKernelResetEnergy.*/
+typedef struct
+{
+    /**Used to store the time over which the energy is counted*/
+    uint64_t elapsedMs;
+    /**Used to store the time spent in the tasks*/
+    uint64_t taskMs;
+    /**Used to store the time spent asleep in uKERNEL_IDLE*/
+    uint64_t sleepMs;
+    /**Used to store the energy in uJ, awake and asleep*/
+    uint64_t energyUj;
+    /**Used to store the energy in uJ that would be used in one hour*/
+    uint64_t perHourUj;
+} uKernelEnergy;
+#endif
+
 extern uint32_t _counterMs;
 
 /**
  * This funtion as to be called before doing anything with the tasker. It
  * initiates the tasker subsystems. If this funtion is not called before doing
- * anything with the tasker all funtions will return false.
+ * anything with the tasker all funtions will return false. With the
+ * calibration it also measures the kernel overhead, it must then be called
+ * before adding any task.
  */
 void uKernelInit(void);
 /**
@@ -97,8 +514,42 @@ bool uKernelAddTask(uKernelTaskDescriptor *pTaskDescriptor,
                     void (*userTask)(void),
                     uint32_t taskInterval,
                     uKernelTaskStatus taskStatus);
+#if uKERNEL_USE_RELEASE_AT
+/**
+ * Add a task whose first release is at an absolute time instead of after its
+ * interval. A time already past runs the task on the next pass; times are
+ * compared by difference so the counter can overflow in between.
+ * @param pTaskDescriptor   Descriptor of the task.
+ * @param userTask          Function pointer on the task body
+ * @param taskInterval Interval in milliseconds after the first release.
+ * @param taskStatus uKernel_SCHEDULED for a periodic task or uKernel_ONETIME.
+ * @param releaseTime Time of the first release, on the _counterMs time base.
+ * @return True or False
+ */
+bool uKernelAddTaskAt(uKernelTaskDescriptor *pTaskDescriptor,
+                      void (*userTask)(void),
+                      uint32_t taskInterval,
+                      uKernelTaskStatus taskStatus,
+                      uint32_t releaseTime);
+/**
+ * Move the next release of a task to an absolute time. Can be called from
+ * the task body itself, then it replaces the release after its interval.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @param releaseTime Time of the next release, on the _counterMs time base.
+ * @param taskStatus uKernel_SCHEDULED or uKernel_ONETIME.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelRescheduleAt(uKernelTaskDescriptor *pTaskDescriptor,
+                         uint32_t releaseTime,
+                         uKernelTaskStatus taskStatus);
+#endif
 /**
  * This funtion is used to remove the task from the scheduler.
+ * With the post queue, a task removed while it is posted stays linked in the
+ * queue of its core until the next scheduler pass of that core drops it. Its
+ * descriptor must stay valid until then, it can't be freed or used for
+ * anything else than adding the task again. Removing it from a task running
+ * on its core and letting one pass go by is enough.
  * @param pTaskDescriptor Descriptor of the task to be removed.
  * @return Return true if all went well, false otherwise.
  */
@@ -116,6 +567,20 @@ bool uKernelPauseTask(uKernelTaskDescriptor *pTaskDescriptor);
  */
 bool uKernelResumeTask(uKernelTaskDescriptor *pTaskDescriptor,
                        uKernelTaskStatus taskStatus);
+#if uKERNEL_USE_PHASE
+/**
+ * Restart a paused task keeping its phase: the next release is the first one
+ * not in the past on the grid of its period started at its first release, so
+ * tasks started together stay aligned after a pause. uKernelResumeTask
+ * instead restarts the period from now. A pause longer than 2^32 ms keeps
+ * the phase only if the period divides 2^32.
+ * @param pTaskDescriptor Descriptor of the task to be resumed.
+ * @param taskStatus uKernel_SCHEDULED or uKernel_ONETIME.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelResumeTaskInPhase(uKernelTaskDescriptor *pTaskDescriptor,
+                              uKernelTaskStatus taskStatus);
+#endif
 /**
  * Add a task into the circular linked list for the scheduler.
  * @param pTaskDescriptor   Descriptor of the task.
@@ -145,10 +610,542 @@ bool uKernelModifyTask(uKernelTaskDescriptor *pTaskDescriptor,
  * @retval ERROR There was an error (task not found)
  */
 uKernelTaskStatus uKernelGetTaskStatus(uKernelTaskDescriptor *pTaskDescriptor);
+#if uKERNEL_USE_START_TOGETHER
+/**
+ * Start or restart several tasks together. All the first releases are
+ * computed from a single reading of the time, so the order in which the tasks
+ * were added doesn't skew them. The tasks must have been added before,
+ * usually as uKernel_PAUSED.
+ * @param pTasks Array with the descriptors of the tasks.
+ * @param pOffsets Array with the offset of each task from the common start
+ *                 in milliseconds, NULL to release them all at the same time.
+ * @param count Number of tasks.
+ * @param delay Time in milliseconds from now to the common start.
+ * @param taskStatus uKernel_SCHEDULED or uKernel_ONETIME.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelStartTasksTogether(uKernelTaskDescriptor * const *pTasks,
+                               const uint32_t *pOffsets,
+                               uint8_t count,
+                               uint32_t delay,
+                               uKernelTaskStatus taskStatus);
+#endif
+/**
+ * Read the milliseconds counter, safe against the tick interrupt on cores
+ * that can't read 32 bits at once.
+ * @return The current time in milliseconds.
+ */
+uint32_t uKernelGetTime(void);
 /**
  * Scheduling. This runs the kernel itself.
  */
 void uKernelScheduler(void);
+#if uKERNEL_USE_COROUTINES
+/**
+ * Returns the descriptor of the task being executed by the scheduler.
+ * @return The running task or NULL if called outside a task body.
+ */
+uKernelTaskDescriptor *uKernelGetCurrentTask(void);
+/**
+ * Called from a task body to set its next release delay milliseconds from now,
+ * instead of its interval. A one time task is kept for that release.
+ * @param delay Time in milliseconds until the next release of the task.
+ * @return Return true if all went well, false if no task is running.
+ */
+bool uKernelTaskSleep(uint32_t delay);
+#endif
+#if uKERNEL_USE_LOOKAHEAD
+/**
+ * Get the next planned releases, the earliest first. The scheduler keeps the
+ * next release of the uKERNEL_LOOKAHEAD_DEPTH tasks due first while it goes
+ * through the tasks, so this is as of its last complete pass. A periodic task
+ * comes back every period, as if it ran on time. When more tasks are running
+ * than the lookahead keeps, the list stops at the last release kept, since a
+ * task left out could come before the ones after it. Paused tasks and
+ * releases by events are not in it.
+ * @param pReleases Array where the releases are copied.
+ * @param maxReleases Size of the array.
+ * @return The number of releases copied.
+ */
+uint8_t uKernelGetNextReleases(uKernelRelease *pReleases, uint8_t maxReleases);
+/**
+ * Get the earliest planned release at or after a given time, the periodic
+ * tasks of the lookahead being repeated every period as for
+ * uKernelGetNextReleases.
+ * @param after Time from which the release is looked for.
+ * @param pRelease Where the release is copied.
+ * @return Return true if one was found, false otherwise or if it would be
+ *         after the last release kept by a full lookahead.
+ */
+bool uKernelGetEarliestRelease(uint32_t after, uKernelRelease *pRelease);
+#endif
+#if uKERNEL_USE_CALIBRATION
+/**
+ * Get the kernel overhead measured by uKernelInit with the cycle counter.
+ * @return The cost of the kernel operations, in cycles of the counter.
+ */
+const uKernelOverhead *uKernelGetOverhead(void);
+#endif
+#if uKERNEL_USE_OVERHEAD
+/**
+ * Get how the CPU time was shared over the last complete window. The kernel
+ * share is what the scheduler spends around the bodies it runs (list walk,
+ * deadline checks, watchdog, statistics). In a pass that runs nothing, the
+ * calibrated cost of the visit counts as kernel time and only the spin or the
+ * sleep left counts as idle; without uKERNEL_USE_CALIBRATION such a pass is
+ * idle as a whole. Each pass is measured with the cycle counter, so a pass must
+ * not be longer than the counter range.
+ * @param pLoad Where the shares are copied.
+ * @return Return true if all went well, false if no window is complete yet.
+ */
+bool uKernelGetCpuLoad(uKernelCpuLoad *pLoad);
+#endif
+#if uKERNEL_USE_TIMESTAMPS
+/**
+ * Called from a task body to get the time the running task was meant to run,
+ * its planned time, or the time the scheduler saw it when it was released by
+ * an event. The difference with uKernelGetStartTime is the dispatch jitter.
+ * @return The release time in milliseconds.
+ */
+uint32_t uKernelGetReleaseTime(void);
+/**
+ * Called from a task body to get the time the scheduler called it.
+ * @return The start time in milliseconds.
+ */
+uint32_t uKernelGetStartTime(void);
+#endif
+/**
+ * To be called every millisecond from the timer interrupt, instead of
+ * incrementing _counterMs. With the budgets it also checks the execution budget
+ * of the running task so the task can see it went over while still running,
+ * on every core with uKERNEL_USE_MULTICORE, so a single core calls it.
+ */
+void uKernelTick(void);
+#if uKERNEL_USE_BUDGET
+/**
+ * Give a task an execution budget. Each run longer than the budget raises the
+ * flag read by uKernelBudgetExceeded and is counted as a violation. With
+ * demote set, a task over budget uKERNEL_BUDGET_DEMOTE_STRIKES times in a row
+ * skips one period after each further overrun until it runs within budget.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @param budget Maximum execution time in milliseconds, 0 to disable.
+ * @param demote True to demote repeat offenders.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelSetTaskBudget(uKernelTaskDescriptor *pTaskDescriptor,
+                          uint16_t budget,
+                          bool demote);
+/**
+ * Called from a task body to know if it already used its whole budget.
+ * @return True if the running task went over its execution budget.
+ */
+bool uKernelBudgetExceeded(void);
+/**
+ * Get the number of runs of a task that went over its execution budget.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @return The number of violations.
+ */
+uint16_t uKernelGetBudgetViolations(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_BACKGROUND
+/**
+ * Add a background task with a weight, it gets weight / (sum of the weights)
+ * of the idle time.
+ * @param pBackgroundTask Descriptor of the background task.
+ * @param userTask Function pointer on the task body.
+ * @param weight Weight of the task, from 1 to 65535.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelAddBackgroundTask(uKernelBackgroundTask *pBackgroundTask,
+                              void (*userTask)(void),
+                              uint16_t weight);
+/**
+ * Remove a background task.
+ * @param pBackgroundTask Descriptor of the background task to be removed.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelRemoveBackgroundTask(uKernelBackgroundTask *pBackgroundTask);
+#endif
+#if uKERNEL_USE_GROUPS
+/**
+ * Initialize a reservation group.
+ * @param pGroup Group to initialize.
+ * @param budget Execution time in milliseconds granted each period.
+ * @param period Replenishment period in milliseconds.
+ * @param pParent Parent group or NULL for a top level group.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelGroupInit(uKernelGroup *pGroup,
+                      uint16_t budget,
+                      uint16_t period,
+                      uKernelGroup *pParent);
+/**
+ * Put a task in a reservation group. Inside the group the tasks keep the
+ * normal round-robin order of the scheduler.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @param pGroup Group of the task, NULL to take it out of its group.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelSetTaskGroup(uKernelTaskDescriptor *pTaskDescriptor,
+                         uKernelGroup *pGroup);
+#endif
+#if uKERNEL_USE_TASK_ID
+/**
+ * Get the identifier given to a task when it was added, as used in the
+ * post-mortem records and the statistics block. The lowest one not in use is
+ * given, and removing the task gives it back.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @return The identifier of the task.
+ */
+uint8_t uKernelGetTaskId(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_TRACE
+/**
+ * Get the last dispatches recorded before the reset. The ring lives in RAM
+ * that isn't cleared at startup, so this has to be called after uKernelInit
+ * and before uKernelScheduler overwrites it. After a power-up the ring is
+ * empty.
+ * @param pRecords Array where the records are copied, the oldest first.
+ * @param maxRecords Size of the array.
+ * @return The number of records copied.
+ */
+uint8_t uKernelGetPostMortem(uKernelDispatchRecord *pRecords,
+                             uint8_t maxRecords);
+#endif
+#if uKERNEL_USE_EVENTS
+/**
+ * Release a task, it will run on the next scheduler pass whatever its planned
+ * time and status. A paused task released this way runs once and stays paused,
+ * so event driven tasks are added as uKernel_PAUSED. Several releases before
+ * the task runs are merged into one. Can be called from an interrupt.
+ * @param pTaskDescriptor Descriptor of the task to be released.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelReleaseTask(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_READY_BITMAP
+/**
+ * Post a task in the ready bitmap, it will run at the start of the next
+ * scheduler pass, before the tasks found by the pass. Posting is a single
+ * OR of the task's bit, so any number of posts before the task runs are
+ * merged into one dispatch. Up to 32 tasks get a bit, freed when the task is removed.
+ * With several cores each core has its own bitmap, a task can only be posted
+ * from its own core, use uKernelEnqueueTask from the other ones.
+ * @param pTaskDescriptor Descriptor of the task to be posted.
+ * @return Return true if all went well, false if the task has no bit or
+ * runs on another core.
+ */
+bool uKernelPostTask(uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Same as uKernelPostTask, to be called from an interrupt.
+ * @param pTaskDescriptor Descriptor of the task to be posted.
+ * @return Return true if all went well, false if the task has no bit.
+ */
+bool uKernelPostTaskFromISR(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_POST_QUEUE
+/**
+ * Put a task in the post queue, it will run at the start of the next
+ * scheduler pass, the tasks in the order they were posted. The queue is
+ * lock-free with the compiler atomics, so it can be posted from other cores
+ * or threads as well as from interrupts. A task already in the queue isn't
+ * queued twice. There is no limit on the number of tasks. Removing a task
+ * drops its pending post, a removed task must not be posted. It can be added
+ * again while the post is still in the queue, but the descriptor can't be
+ * released before the queue is drained, see uKernelRemoveTask.
+ * @param pTaskDescriptor Descriptor of the task to be posted.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelEnqueueTask(uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Same as uKernelEnqueueTask, to be called from an interrupt.
+ * @param pTaskDescriptor Descriptor of the task to be posted.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelEnqueueTaskFromISR(uKernelTaskDescriptor *pTaskDescriptor);
+#endif
+#if uKERNEL_USE_MULTICORE
+/**
+ * Pin a task on its core, the balancer won't move it. Tasks that aren't
+ * periodic are never moved by the balancer.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @param pinned true to keep the task on its core, false to let it move.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelPinTask(uKernelTaskDescriptor *pTaskDescriptor, bool pinned);
+/**
+ * Move a task to another core, it keeps its planned time and runs there from
+ * that core's next scheduler pass. Has to be called on the core running the
+ * task, but not from the task itself.
+ * @param pTaskDescriptor Descriptor of the task to be moved.
+ * @param core Core where the task goes.
+ * @return Return true if all went well, false if the task is pinned or
+ * doesn't belong to this core.
+ */
+bool uKernelMigrateTask(uKernelTaskDescriptor *pTaskDescriptor, uint8_t core);
+#if uKERNEL_USE_CORE_STATS
+/**
+ * Get the run statistics of a task, added up over all the cores.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @param pStats Where the statistics are copied.
+ * @return Return true if all went well, false if the task has no statistics.
+ */
+bool uKernelGetTaskStats(uKernelTaskDescriptor *pTaskDescriptor,
+                         uKernelTaskStats *pStats);
+#endif
+/**
+ * Get the core running a task.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @return Return the core of the task.
+ */
+uint8_t uKernelGetTaskCore(uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Get the load of a core measured over its last balancing window.
+ * @param core Core number.
+ * @return The load of the core in permille.
+ */
+uint16_t uKernelGetCoreLoad(uint8_t core);
+#endif
+#if uKERNEL_USE_JOBS
+/**
+ * Queue a job, jobs run one after the other in the order they were queued.
+ * @param pJob Job descriptor, it must stay valid until the job is done.
+ * @param jobStep Function pointer on the step of the job.
+ * @param pState Job state given to the steps in pJob->pState.
+ * @param pNotifyTask Task released when the job is done, can be NULL.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelSubmitJob(uKernelJob *pJob,
+                      JobStep jobStep,
+                      void *pState,
+                      uKernelTaskDescriptor *pNotifyTask);
+/**
+ * Remove a job that is not done yet.
+ * @param pJob Job to be removed.
+ * @return Return true if all went well, false if it wasn't waiting.
+ */
+bool uKernelCancelJob(uKernelJob *pJob);
+/**
+ * Get the progress of a job.
+ * @param pJob Job descriptor.
+ * @return The progress from 0 to 100, 100 once the job is done.
+ */
+uint8_t uKernelGetJobProgress(uKernelJob *pJob);
+#endif
+#if uKERNEL_USE_PINGPONG
+/**
+ * Initialize a ping-pong buffer. The producer starts filling the first buffer.
+ * @param pPingPong Ping-pong buffer to initialize.
+ * @param pBuffers Array with the pointers to the buffers.
+ * @param bufferCount Number of buffers, 2 for double or 3 for triple buffering.
+ * @param pConsumerTask Task released when a buffer is ready, can be NULL.
+ * @return The first buffer to be filled or NULL on error.
+ */
+void *uKernelPingPongInit(uKernelPingPong *pPingPong,
+                          void * const *pBuffers,
+                          uint8_t bufferCount,
+                          uKernelTaskDescriptor *pConsumerTask);
+/**
+ * To be called from the producer interrupt (DMA complete) when the current
+ * buffer is full. The buffer is handed to the consumer, which is released, and
+ * the next free buffer is given to the producer. If the consumer still holds
+ * the only other buffer the block is dropped and the same buffer is returned.
+ * @param pPingPong Ping-pong buffer.
+ * @return The buffer the producer has to fill next.
+ */
+void *uKernelPingPongFilledFromISR(uKernelPingPong *pPingPong);
+/**
+ * Called by the consumer task to take the newest filled buffer. When a buffer
+ * is taken the one acquired before, if any, is given back to the producer.
+ * @param pPingPong Ping-pong buffer.
+ * @return The filled buffer or NULL if there is none.
+ */
+void *uKernelPingPongAcquire(uKernelPingPong *pPingPong);
+/**
+ * Called by the consumer task when it is done with the acquired buffer.
+ * @param pPingPong Ping-pong buffer.
+ */
+void uKernelPingPongRelease(uKernelPingPong *pPingPong);
+#endif
+#if uKERNEL_USE_LATEST
+/**
+ * Initialize a latest value triple buffer.
+ * @param pLatest Triple buffer to initialize.
+ * @param pBuffers Array with the pointers to three buffers of the same size.
+ * @return The buffer where the writer has to write the first value.
+ */
+void *uKernelLatestInit(uKernelLatest *pLatest, void * const *pBuffers);
+/**
+ * Publish the value written in the writer buffer, never blocks.
+ * @param pLatest Triple buffer.
+ * @return The buffer where the writer has to write the next value.
+ */
+void *uKernelLatestPublish(uKernelLatest *pLatest);
+/**
+ * Same as uKernelLatestPublish but to be called from an interrupt.
+ */
+void *uKernelLatestPublishFromISR(uKernelLatest *pLatest);
+/**
+ * Get the latest published value, never blocks. The buffer belongs to the
+ * reader until its next call.
+ * @param pLatest Triple buffer.
+ * @return The latest value or NULL if nothing has been published yet.
+ */
+const void *uKernelLatestRead(uKernelLatest *pLatest);
+/**
+ * Same as uKernelLatestRead but to be called from an interrupt.
+ */
+const void *uKernelLatestReadFromISR(uKernelLatest *pLatest);
+#endif
+#if uKERNEL_USE_PUBSUB
+/**
+ * Initialize a frame pool over the user's storage. The frames and the storage
+ * are cut in frameCount frames of frameSize bytes. The publish/subscribe
+ * functions are to be called from tasks only, not from interrupts.
+ * @param pPool Pool to initialize.
+ * @param pFrames Array of frameCount frame descriptors.
+ * @param pStorage Memory for the frames data, frameCount * frameSize bytes.
+ * @param frameSize Size of each frame in bytes.
+ * @param frameCount Number of frames.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelFramePoolInit(uKernelFramePool *pPool,
+                          uKernelFrame *pFrames,
+                          void *pStorage,
+                          uint16_t frameSize,
+                          uint8_t frameCount);
+/**
+ * Take a frame from a pool, the caller holds the only reference.
+ * @param pPool Pool to take the frame from.
+ * @return The frame or NULL if the pool is empty.
+ */
+uKernelFrame *uKernelFrameAlloc(uKernelFramePool *pPool);
+/**
+ * Release a reference on a frame, the last one gives it back to its pool.
+ * @param pFrame Frame to release.
+ */
+void uKernelFrameRelease(uKernelFrame *pFrame);
+/**
+ * Subscribe a task to a topic.
+ * @param pTopic Topic to subscribe to.
+ * @param pSubscriber Subscription, it must stay valid while subscribed.
+ * @param pTaskDescriptor Task released each time a frame is published.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelSubscribe(uKernelTopic *pTopic,
+                      uKernelSubscriber *pSubscriber,
+                      uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Remove a subscription from a topic, a frame not taken is released.
+ * @param pTopic Topic the subscription belongs to.
+ * @param pSubscriber Subscription to remove.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelUnsubscribe(uKernelTopic *pTopic, uKernelSubscriber *pSubscriber);
+/**
+ * Publish a frame to all the subscribers of a topic. Each subscriber gets a
+ * reference on the same frame and its task is released. The reference of the
+ * publisher is handed over, it must not release the frame afterwards.
+ * @param pTopic Topic to publish to.
+ * @param pFrame Frame to publish.
+ * @return The number of subscribers that got the frame.
+ */
+uint8_t uKernelPublish(uKernelTopic *pTopic, uKernelFrame *pFrame);
+/**
+ * Take the frame published for a subscriber, to be called by its task. The
+ * task owns the reference and releases it with uKernelFrameRelease.
+ * @param pSubscriber Subscription of the task.
+ * @return The frame or NULL if nothing has been published since last time.
+ */
+uKernelFrame *uKernelTake(uKernelSubscriber *pSubscriber);
+#endif
+#if uKERNEL_USE_ENERGY
+/**
+ * Get the energy used by the whole system, estimated from the time spent
+ * awake and asleep and the power figures of the port. The time has the tick
+ * resolution.
+ * @param pEnergy Where the figures are copied.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelGetEnergy(uKernelEnergy *pEnergy);
+/**
+ * Get the energy used by a task, its run time at the active power. The run
+ * time of a task is counted on 32 bits, up to 49.7 days.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @return The energy in uJ.
+ */
+uint64_t uKernelGetTaskEnergy(uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Get the energy a task uses in one hour at its rate so far.
+ * @param pTaskDescriptor Descriptor of the task.
+ * @return The energy in uJ per hour.
+ */
+uint64_t uKernelGetTaskEnergyPerHour(uKernelTaskDescriptor *pTaskDescriptor);
+/**
+ * Restart counting the energy, of the system and of the tasks.
+ */
+void uKernelResetEnergy(void);
+#endif
+#if uKERNEL_USE_DVFS
+/**
+ * Get the frequency level selected by the scheduler.
+ * @return The level, an index in uKERNEL_DVFS_SPEEDS.
+ */
+uint8_t uKernelGetFrequencyLevel(void);
+/**
+ * Get the utilization the tasks need at full speed, as last predicted from
+ * their intervals and run times.
+ * @return The utilization in permille.
+ */
+uint16_t uKernelGetRequiredUtilization(void);
+#endif
+#if uKERNEL_USE_DEADLINE_QUEUE
+/**
+ * Initialize a deadline queue. The consumer task is added as uKernel_PAUSED,
+ * the queue runs it once for the most urgent message each time, it gets its
+ * messages with uKernelDeadlineQueueReceive.
+ * @param pQueue Queue to initialize.
+ * @param pStorage Array of capacity messages.
+ * @param capacity Number of messages the queue can hold.
+ * @param leadTime Time before its deadline at which a message is handled.
+ * @param pConsumerTask Task handling the messages, can be NULL.
+ * @return Return true if all went well, false otherwise.
+ */
+bool uKernelDeadlineQueueInit(uKernelDeadlineQueue *pQueue,
+                              uKernelDeadlineMessage *pStorage,
+                              uint8_t capacity,
+                              uint32_t leadTime,
+                              uKernelTaskDescriptor *pConsumerTask);
+/**
+ * Send a message to a deadline queue, the consumer is brought forward if the
+ * message is the most urgent one.
+ * @param pQueue Queue to send to.
+ * @param pMessage Message, only the pointer is queued.
+ * @param deadline Time (uKernelGetTime) by which the message is handled.
+ * @return Return true if all went well, false if the queue is full.
+ */
+bool uKernelDeadlineQueueSend(uKernelDeadlineQueue *pQueue,
+                              void *pMessage,
+                              uint32_t deadline);
+/**
+ * Same as uKernelDeadlineQueueSend but to be called from an interrupt. The
+ * consumer is released, it runs on the next pass and is planned again by
+ * uKernelDeadlineQueueReceive.
+ */
+bool uKernelDeadlineQueueSendFromISR(uKernelDeadlineQueue *pQueue,
+                                     void *pMessage,
+                                     uint32_t deadline);
+/**
+ * Take the most urgent message of a deadline queue once its deadline minus
+ * the lead time has come, to be called by the consumer task. The consumer is
+ * planned for the next message left in the queue.
+ * @param pQueue Queue to receive from.
+ * @param pDeadline Where the deadline of the message is copied, can be NULL.
+ * @return The message or NULL if the queue is empty or no message is due.
+ */
+void *uKernelDeadlineQueueReceive(uKernelDeadlineQueue *pQueue,
+                                  uint32_t *pDeadline);
+#endif
 /**
  * Just a simple delay in miliseconds. Not related to the Tasker system.
  */
@@ -0,0 +1,383 @@
+/**
+ *  @file           uKernelConfig.h
+ *  @author         Luis Maduro
+ *  @version        1.0
+ *  @date           03/05/2013
+ *  @copyright		GNU General Public License
+ *
+ *  @brief Configuration of the scheduler.
+ *  Every optional feature has a switch here, set it to 1 to use it. A feature
+ *  that is switched off is completely compiled out, it doesn't take any code
+ *  or RAM, so with all of them off the scheduler is the plain version plus the
+ *  uKernelTick and uKernelGetTime time functions. Every value can also be
+ *  given on the compiler command line (-D).
+ *  The RAM given for each feature is what it adds to each task descriptor,
+ *  its global variables come on top of that.
+ */
+
+#ifndef UKERNEL_CONFIG_H
+#define	UKERNEL_CONFIG_H
+
+#ifndef MAX_TASKS_NUMBER
+#define MAX_TASKS_NUMBER                255
+#endif
+
+/**Set your max interval here (max 2^32-1) - default 3600000 (1 hour)*/
+#ifndef MAX_TASK_INTERVAL
+#define MAX_TASK_INTERVAL               3600000UL
+#endif
+
+/**Used to protect data shared with interrupts, change them for your core.*/
+#ifndef uKERNEL_DISABLE_INTERRUPTS
+#define uKERNEL_DISABLE_INTERRUPTS()    di()
+#define uKERNEL_ENABLE_INTERRUPTS()     ei()
+#endif
+
+/**
+ * Free running cycle counter of the port, for measurements finer than the
+ * millisecond, e.g. a timer register on a PIC or DWT->CYCCNT on a Cortex-M.
+ * Leave it undefined if there is none, the features using it need it.
+ */
+/* #define uKERNEL_CYCLE_COUNTER()         TMR1 */
+
+/**Type of the cycle counter, the differences wrap with it.*/
+#ifndef uKERNEL_CYCLE_TYPE
+#define uKERNEL_CYCLE_TYPE              uint32_t
+#endif
+
+/**Coroutine tasks: uKernelTaskSleep and the uKERNEL_CO_ macros.*/
+#ifndef uKERNEL_USE_COROUTINES
+#define uKERNEL_USE_COROUTINES          0
+#endif
+
+/**Releases at an absolute time: uKernelAddTaskAt and uKernelRescheduleAt.*/
+#ifndef uKERNEL_USE_RELEASE_AT
+#define uKERNEL_USE_RELEASE_AT          0
+#endif
+
+/**Tasks started from a single reading of the time: uKernelStartTasksTogether.*/
+#ifndef uKERNEL_USE_START_TOGETHER
+#define uKERNEL_USE_START_TOGETHER      0
+#endif
+
+/**Events: uKernelReleaseTask, 1 byte per task.*/
+#ifndef uKERNEL_USE_EVENTS
+#define uKERNEL_USE_EVENTS              0
+#endif
+
+/**Ping-pong buffers between a producer ISR and a task, needs the events.*/
+#ifndef uKERNEL_USE_PINGPONG
+#define uKERNEL_USE_PINGPONG            0
+#endif
+
+/**Latest value triple buffers.*/
+#ifndef uKERNEL_USE_LATEST
+#define uKERNEL_USE_LATEST              0
+#endif
+
+/**Publish/subscribe topics with pooled frames, needs the events.*/
+#ifndef uKERNEL_USE_PUBSUB
+#define uKERNEL_USE_PUBSUB              0
+#endif
+
+/**Ready bitmap posted from interrupts, for 32 tasks, 1 byte per task.*/
+#ifndef uKERNEL_USE_READY_BITMAP
+#define uKERNEL_USE_READY_BITMAP        0
+#endif
+
+/**Post queue for other cores and interrupts, 1 pointer and 1 byte per task.*/
+#ifndef uKERNEL_USE_POST_QUEUE
+#define uKERNEL_USE_POST_QUEUE          0
+#endif
+
+/**Message queues ordered by deadline, needs the events.*/
+#ifndef uKERNEL_USE_DEADLINE_QUEUE
+#define uKERNEL_USE_DEADLINE_QUEUE      0
+#endif
+
+/**Execution budgets, 5 bytes per task.*/
+#ifndef uKERNEL_USE_BUDGET
+#define uKERNEL_USE_BUDGET              0
+#endif
+
+/**Consecutive budget overruns after which a task is demoted, if asked.*/
+#ifndef uKERNEL_BUDGET_DEMOTE_STRIKES
+#define uKERNEL_BUDGET_DEMOTE_STRIKES   3
+#endif
+
+/**Weighted background tasks sharing the idle time (stride scheduling).*/
+#ifndef uKERNEL_USE_BACKGROUND
+#define uKERNEL_USE_BACKGROUND          0
+#endif
+
+/**Maximum number of background tasks sharing the idle time.*/
+#ifndef uKERNEL_MAX_BACKGROUND_TASKS
+#define uKERNEL_MAX_BACKGROUND_TASKS    8
+#endif
+
+/**Stride of a background task of weight 1, the stride is this over weight.*/
+#ifndef uKERNEL_STRIDE_ONE
+#define uKERNEL_STRIDE_ONE              65535U
+#endif
+
+/**Reservation groups, 1 pointer per task.*/
+#ifndef uKERNEL_USE_GROUPS
+#define uKERNEL_USE_GROUPS              0
+#endif
+
+/**Periodic tasks kept on their phase grid and resumed on it, 4 bytes per task.*/
+#ifndef uKERNEL_USE_PHASE
+#define uKERNEL_USE_PHASE               0
+#endif
+
+/**Incremental background jobs run in the idle time, needs the events.*/
+#ifndef uKERNEL_USE_JOBS
+#define uKERNEL_USE_JOBS                0
+#endif
+
+/**Time kept free before the next planned release when running a job.*/
+#ifndef uKERNEL_JOB_GUARD_MS
+#define uKERNEL_JOB_GUARD_MS            1
+#endif
+
+/**Longest time a job runs in one go, even with more idle time ahead.*/
+#ifndef uKERNEL_JOB_MAX_CHUNK_MS
+#define uKERNEL_JOB_MAX_CHUNK_MS        10
+#endif
+
+/**Lookahead of the next releases, gathered while the scheduler passes.*/
+#ifndef uKERNEL_USE_LOOKAHEAD
+#define uKERNEL_USE_LOOKAHEAD           0
+#endif
+
+/**Number of next releases kept by the lookahead.*/
+#ifndef uKERNEL_LOOKAHEAD_DEPTH
+#define uKERNEL_LOOKAHEAD_DEPTH         4
+#endif
+
+/**Planned release and start time of the running task.*/
+#ifndef uKERNEL_USE_TIMESTAMPS
+#define uKERNEL_USE_TIMESTAMPS          0
+#endif
+
+/**Tracing of the dispatches in the post-mortem ring, 1 byte per task.*/
+#ifndef uKERNEL_USE_TRACE
+#define uKERNEL_USE_TRACE               0
+#endif
+
+/**Number of dispatches kept in the post-mortem ring.*/
+#ifndef uKERNEL_POSTMORTEM_RECORDS
+#define uKERNEL_POSTMORTEM_RECORDS      16
+#endif
+
+/**Measure the kernel overhead in uKernelInit, needs the cycle counter.*/
+#ifndef uKERNEL_USE_CALIBRATION
+#define uKERNEL_USE_CALIBRATION         0
+#endif
+
+/**Number of measurements of each operation, the shortest one is kept.*/
+#ifndef uKERNEL_CALIBRATION_RUNS
+#define uKERNEL_CALIBRATION_RUNS        8
+#endif
+
+/**Share of the CPU spent in the kernel, the tasks and idle, needs the cycle
+ * counter.*/
+#ifndef uKERNEL_USE_OVERHEAD
+#define uKERNEL_USE_OVERHEAD            0
+#endif
+
+/**Window in milliseconds over which the CPU shares are computed.*/
+#ifndef uKERNEL_OVERHEAD_WINDOW_MS
+#define uKERNEL_OVERHEAD_WINDOW_MS      1000
+#endif
+
+/**Live statistics block at a fixed place for debuggers, 1 byte per task.*/
+#ifndef uKERNEL_USE_WATCH
+#define uKERNEL_USE_WATCH               0
+#endif
+
+/**Number of tasks, by identifier, that have their statistics in the block.*/
+#ifndef uKERNEL_WATCH_TASKS
+#define uKERNEL_WATCH_TASKS             16
+#endif
+
+/**Window in milliseconds of the CPU load of the block, without the overhead.*/
+#ifndef uKERNEL_WATCH_WINDOW_MS
+#define uKERNEL_WATCH_WINDOW_MS         1000
+#endif
+
+/**Section of the statistics block, place it with the linker script.*/
+#ifndef uKERNEL_WATCH_SECTION
+#if defined(__XC8)
+#define uKERNEL_WATCH_SECTION           __section("ukwatch")
+#else
+#define uKERNEL_WATCH_SECTION           __attribute__((section(".ukernel_watch")))
+#endif
+#endif
+
+/**
+ * One scheduler per core, each core calls uKernelInit at startup before any
+ * task is added, then runs its own uKernelScheduler. Only one core calls
+ * uKernelTick. Needs the compiler atomics and uKERNEL_CORE_ID().
+ */
+#ifndef uKERNEL_USE_MULTICORE
+#define uKERNEL_USE_MULTICORE           0
+#endif
+
+/**Number of cores running a scheduler.*/
+#ifndef uKERNEL_CORES
+#define uKERNEL_CORES                   2
+#endif
+
+/**Number of the core running the caller, from 0 to uKERNEL_CORES - 1.*/
+/* #define uKERNEL_CORE_ID()               get_core_num() */
+
+/**Window in milliseconds over which the loads of the cores are compared.*/
+#ifndef uKERNEL_BALANCE_MS
+#define uKERNEL_BALANCE_MS              100
+#endif
+
+/**Load difference in permille above which a task is moved.*/
+#ifndef uKERNEL_BALANCE_MARGIN
+#define uKERNEL_BALANCE_MARGIN          100
+#endif
+
+/**Per-core run statistics of the tasks, merged when read.*/
+#ifndef uKERNEL_USE_CORE_STATS
+#define uKERNEL_USE_CORE_STATS          0
+#endif
+
+/**Number of tasks, by identifier, that have run statistics.*/
+#ifndef uKERNEL_STATS_TASKS
+#define uKERNEL_STATS_TASKS             16
+#endif
+
+/**Size of a cache line, 0 to pack the per-core data without padding.*/
+#ifndef uKERNEL_CACHE_LINE
+#define uKERNEL_CACHE_LINE              64
+#endif
+
+/**Puts data written by different cores on different cache lines, it can
+ * also be used on the task descriptors.*/
+#ifndef uKERNEL_CACHE_ALIGNED
+#if uKERNEL_CACHE_LINE > 0
+#define uKERNEL_CACHE_ALIGNED           __attribute__((aligned(uKERNEL_CACHE_LINE)))
+#else
+#define uKERNEL_CACHE_ALIGNED
+#endif
+#endif
+
+/**
+ * Qualifier of the state each core has its own copy of. Thread local storage
+ * by default, for the host port with a thread per core. On a target without
+ * it, give a qualifier placing the variables in per-core RAM.
+ */
+#ifndef uKERNEL_CORE_LOCAL
+#if uKERNEL_USE_MULTICORE && defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define uKERNEL_CORE_LOCAL              _Thread_local
+#elif uKERNEL_USE_MULTICORE
+#define uKERNEL_CORE_LOCAL              __thread
+#else
+#define uKERNEL_CORE_LOCAL
+#endif
+#endif
+
+/**
+ * Idle hook of the port, called when a whole pass had nothing to do. It puts
+ * the core to sleep until the next interrupt, e.g. Sleep() on a PIC or
+ * __WFI() on a Cortex-M. Leave it undefined to keep the scheduler spinning.
+ */
+/* #define uKERNEL_IDLE()                  Sleep() */
+
+/**Energy used by each task and by the system, 4 bytes per task.*/
+#ifndef uKERNEL_USE_ENERGY
+#define uKERNEL_USE_ENERGY              0
+#endif
+
+/**Power drawn while the core is awake, in uW.*/
+#ifndef uKERNEL_ACTIVE_POWER_UW
+#define uKERNEL_ACTIVE_POWER_UW         10000UL
+#endif
+
+/**Power drawn while the core sleeps in uKERNEL_IDLE, in uW.*/
+#ifndef uKERNEL_SLEEP_POWER_UW
+#define uKERNEL_SLEEP_POWER_UW          10UL
+#endif
+
+/**Clock scaling from the predicted utilization, 2 bytes per task.*/
+#ifndef uKERNEL_USE_DVFS
+#define uKERNEL_USE_DVFS                0
+#endif
+
+/**Number of frequency levels of the port.*/
+#ifndef uKERNEL_DVFS_LEVELS
+#define uKERNEL_DVFS_LEVELS             3
+#endif
+
+/**Speed of each level in permille of the full speed, the last one is 1000.*/
+#ifndef uKERNEL_DVFS_SPEEDS
+#define uKERNEL_DVFS_SPEEDS             { 250, 500, 1000 }
+#endif
+
+/**Window in milliseconds after which the frequency is chosen again.*/
+#ifndef uKERNEL_DVFS_WINDOW_MS
+#define uKERNEL_DVFS_WINDOW_MS          500
+#endif
+
+/**Highest utilization in permille allowed at the chosen level.*/
+#ifndef uKERNEL_DVFS_TARGET
+#define uKERNEL_DVFS_TARGET             800
+#endif
+
+/**
+ * Frequency hook of the port, it switches the clock to the level and reloads
+ * the tick timer so the tick stays at 1 ms.
+ */
+/* #define uKERNEL_SET_FREQUENCY(level)    setClockLevel(level) */
+
+/**Qualifier for variables that must survive a reset (not cleared at startup).*/
+#ifndef uKERNEL_NOINIT
+#if defined(__XC8)
+#define uKERNEL_NOINIT                  __persistent
+#elif defined(__XC16__) || defined(__XC32__)
+#define uKERNEL_NOINIT                  __attribute__((persistent))
+#else
+#define uKERNEL_NOINIT                  __attribute__((section(".noinit")))
+#endif
+#endif
+
+/**The tasks keep an average of their run time for the balancer and DVFS.*/
+#define uKERNEL_USE_EXEC_AVERAGE        (uKERNEL_USE_MULTICORE || uKERNEL_USE_DVFS)
+
+/**The tasks get an identifier for the tracing and the statistics.*/
+#define uKERNEL_USE_TASK_ID             (uKERNEL_USE_TRACE || uKERNEL_USE_WATCH \
+                                         || uKERNEL_USE_CORE_STATS)
+
+#if (uKERNEL_USE_PINGPONG || uKERNEL_USE_PUBSUB || uKERNEL_USE_JOBS \
+     || uKERNEL_USE_DEADLINE_QUEUE) && !uKERNEL_USE_EVENTS
+#error "uKernel: ping-pong buffers, topics, jobs and deadline queues need uKERNEL_USE_EVENTS"
+#endif
+
+#if (uKERNEL_USE_CALIBRATION || uKERNEL_USE_OVERHEAD) \
+    && !defined(uKERNEL_CYCLE_COUNTER)
+#error "uKernel: the calibration and the overhead need uKERNEL_CYCLE_COUNTER"
+#endif
+
+#if uKERNEL_USE_MULTICORE \
+    && (!defined(uKERNEL_CORE_ID) || !defined(__ATOMIC_ACQ_REL))
+#error "uKernel: the multicore scheduler needs uKERNEL_CORE_ID and atomics"
+#endif
+
+#if uKERNEL_USE_DVFS && !defined(uKERNEL_SET_FREQUENCY)
+#error "uKernel: the clock scaling needs uKERNEL_SET_FREQUENCY"
+#endif
+
+#if uKERNEL_USE_MULTICORE && (uKERNEL_USE_WATCH || uKERNEL_USE_TRACE)
+#error "uKernel: the statistics block and the tracing are for one core, use uKERNEL_USE_CORE_STATS"
+#endif
+
+#if uKERNEL_USE_CORE_STATS && !uKERNEL_USE_MULTICORE
+#error "uKernel: the per-core statistics need uKERNEL_USE_MULTICORE"
+#endif
+
+#endif	/* UKERNEL_CONFIG_H */